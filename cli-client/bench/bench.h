@@ -0,0 +1,28 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+
+namespace bench {
+    /**
+     * @brief Written by the benchmarks so the compiler keeps the work they measure
+     */
+    inline volatile size_t sink = 0;
+
+    /**
+     * @brief Run f repeats times and return the fastest run in microseconds
+     */
+    template<typename F>
+    double best_microseconds(int repeats, F&& f)
+    {
+        double best = 0;
+        for (int i = 0; i < repeats; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            if (i == 0 || elapsed.count() < best)
+                best = elapsed.count();
+        }
+        return best;
+    }
+}
@@ -0,0 +1,69 @@
+// Diffs two 128 KiB snapshots that differ by 20 bytes with each diff kernel the cpu supports.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "nwaasiodiff.h"
+#include "bench.h"
+
+static const char* kernel_name(nwaasio::diff_kernel kernel)
+{
+	switch (kernel)
+	{
+	case nwaasio::diff_kernel::SCALAR:
+		return "scalar";
+	case nwaasio::diff_kernel::SSE2:
+		return "SSE2";
+	case nwaasio::diff_kernel::AVX2:
+		return "AVX2";
+	}
+	return "?";
+}
+
+
+int main()
+{
+	const size_t size = 128 * 1024;
+	const int repeats = 200;
+
+	std::mt19937 random(42);
+	std::vector<uint8_t> before(size);
+	for (auto& byte : before)
+		byte = (uint8_t)random();
+	std::vector<uint8_t> after = before;
+	for (int i = 0; i < 20; i++)
+		after[random() % size] ^= 0x5A;
+
+	std::vector<nwaasio::diff_run> runs;
+	std::vector<nwaasio::diff_run> reference;
+	std::vector<uint64_t> bitmap;
+	nwaasio::diff_kernel best = nwaasio::active_diff_kernel();
+	for (auto kernel : {nwaasio::diff_kernel::AVX2, nwaasio::diff_kernel::SSE2, nwaasio::diff_kernel::SCALAR})
+	{
+		if (nwaasio::set_diff_kernel(kernel) != kernel)
+		{
+			std::printf("%s: not supported\n", kernel_name(kernel));
+			continue;
+		}
+		size_t changed = 0;
+		double runs_time = bench::best_microseconds(repeats, [&] {
+			changed = nwaasio::diff_runs(before.data(), after.data(), size, runs);
+		});
+		double blocks_time = bench::best_microseconds(repeats, [&] {
+			bench::sink = bench::sink + nwaasio::diff_blocks(before.data(), after.data(), size, 256, bitmap);
+		});
+		if (reference.empty())
+			reference = runs;
+		bool same = runs.size() == reference.size();
+		for (size_t i = 0; same && i < runs.size(); i++)
+			same = runs[i].offset == reference[i].offset && runs[i].length == reference[i].length;
+		if (same == false)
+		{
+			std::printf("FAILED, %s does not find the same runs\n", kernel_name(kernel));
+			return 1;
+		}
+		std::printf("%s: diff_runs %.1f us (%zu bytes changed), diff_blocks %.1f us\n", kernel_name(kernel), runs_time, changed, blocks_time);
+	}
+	nwaasio::set_diff_kernel(best);
+	return 0;
+}
@@ -0,0 +1,74 @@
+// Dumps 128 KiB as hex in 16 byte rows, with the former ostringstream formatting,
+// with buffer_to_hex and with buffer_to_hex_chars, then decodes it back with hex_to_buffer.
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "nwaasio.h"
+#include "bench.h"
+
+// What buffer_to_hex did before it used buffer_to_hex_chars
+static std::string stream_to_hex(const uint8_t* data, size_t size, const std::string& sep)
+{
+	std::ostringstream f;
+	for (size_t i = 0; i < size; i++)
+	{
+		f << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+		if (i + 1 != size)
+			f << sep;
+	}
+	return f.str();
+}
+
+
+int main()
+{
+	const size_t size = 128 * 1024;
+	const size_t row = 16;
+	const int repeats = 20;
+
+	std::vector<uint8_t> memory(size);
+	for (size_t i = 0; i < size; i++)
+		memory[i] = (uint8_t)(i * 7 + (i >> 8));
+	std::string dump;
+	dump.reserve(size * 3);
+
+	double stream_time = bench::best_microseconds(repeats, [&] {
+		dump.clear();
+		for (size_t offset = 0; offset < size; offset += row)
+			dump += stream_to_hex(memory.data() + offset, row, ".");
+	});
+	std::string expected = dump;
+	double string_time = bench::best_microseconds(repeats, [&] {
+		dump.clear();
+		for (size_t offset = 0; offset < size; offset += row)
+			dump += nwaasio::buffer_to_hex(memory.data() + offset, row, ".");
+	});
+	bool same = dump == expected;
+	double chars_time = bench::best_microseconds(repeats, [&] {
+		dump.clear();
+		char line[64];
+		for (size_t offset = 0; offset < size; offset += row)
+			dump.append(line, nwaasio::buffer_to_hex_chars(memory.data() + offset, row, line, '.'));
+	});
+	same = same && dump == expected;
+
+	std::string hex = nwaasio::buffer_to_hex(memory.data(), size);
+	std::vector<uint8_t> decoded(size);
+	double decode_time = bench::best_microseconds(repeats, [&] {
+		bench::sink = bench::sink + nwaasio::hex_to_buffer(hex, decoded.data());
+	});
+	same = same && std::memcmp(decoded.data(), memory.data(), size) == 0;
+	if (same == false)
+	{
+		std::printf("FAILED, the implementations do not agree\n");
+		return 1;
+	}
+	std::printf("128 KiB in %zu byte rows: ostringstream %.0f us, buffer_to_hex %.0f us, buffer_to_hex_chars %.0f us\n",
+		row, stream_time, string_time, chars_time);
+	std::printf("hex_to_buffer of 128 KiB: %.0f us\n", decode_time);
+	return 0;
+}
@@ -0,0 +1,68 @@
+// Pushes 128 KiB snapshots with a few dozen small changes each in a snapshot_history, then
+// reports the memory per snapshot, the time of random gets and of rewinding one snapshot at a time.
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "nwaasiohistory.h"
+#include "bench.h"
+
+int main()
+{
+	const size_t size = 128 * 1024;
+	const int snapshots = 512;
+	const int check_every = 32;
+	const int repeats = 3;
+
+	// Half of the memory is zeroed, like the unused parts of a console work ram
+	std::mt19937 random(42);
+	std::vector<uint8_t> memory(size, 0);
+	for (size_t i = 0; i < size / 2; i++)
+		memory[i] = (uint8_t)random();
+
+	nwaasio::snapshot_history history(size, 256 * 1024 * 1024, 64);
+	std::vector<std::vector<uint8_t> > copies;
+	double push_time = bench::best_microseconds(1, [&] {
+		for (int s = 0; s < snapshots; s++)
+		{
+			// A few dozen changes of 1 to 4 bytes, some of them close to each other
+			for (int change = 0; change < 32; change++)
+			{
+				size_t offset = random() % (size - 4);
+				size_t length = 1 + random() % 4;
+				for (size_t i = 0; i < length; i++)
+					memory[offset + i] += 1;
+			}
+			history.push(memory.data());
+			if (s % check_every == 0)
+				copies.push_back(memory);
+		}
+	});
+
+	std::vector<uint8_t> out(size);
+	for (size_t i = 0; i < copies.size(); i++)
+	{
+		if (history.get(history.first() + i * check_every, out.data()) == false || out != copies[i])
+		{
+			std::printf("FAILED, snapshot %zu was not rebuilt\n", i * check_every);
+			return 1;
+		}
+	}
+
+	const int gets = 200;
+	double get_time = bench::best_microseconds(repeats, [&] {
+		for (int i = 0; i < gets; i++)
+			history.get(history.first() + random() % history.count(), out.data());
+	});
+	double rewind_time = bench::best_microseconds(repeats, [&] {
+		for (uint64_t sequence = history.last() + 1; sequence-- > history.first(); )
+			history.get(sequence, out.data());
+	});
+
+	const auto& stats = history.statistics();
+	std::printf("%llu snapshots of %zu bytes, %llu keyframes: %.0f bytes per snapshot, push %.1f us\n",
+		(unsigned long long)stats.snapshots, size, (unsigned long long)stats.keyframes, stats.bytes_per_snapshot(), push_time / snapshots);
+	std::printf("random get %.1f us, rewind step %.1f us\n", get_time / gets, rewind_time / history.count());
+	return 0;
+}
@@ -0,0 +1,40 @@
+// Measures the throughput of ascii_parser over a large reply received in 2 KiB fragments.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "nwaasio.h"
+#include "nwaasioparser.h"
+#include "bench.h"
+
+int main()
+{
+	const size_t fragment_size = 2048;
+	const int repeats = 20;
+
+	// Lines of a few dozen bytes, like a list reply
+	std::string body;
+	for (int i = 0; body.size() < (1 << 20); i++)
+		body += "name:core" + std::to_string(i) + "\nplatform:SNES\nfile:/usr/lib/cores/core" + std::to_string(i) + "_libretro.so\n";
+	body += "\n";
+
+	nwaasio::ascii_parser parser;
+	nwaasio::reply r;
+	r.type = nwaasio::reply::reply_type::ASCII;
+	size_t entries = 0;
+	double time = bench::best_microseconds(repeats, [&] {
+		r._clear_ascii_entries();
+		parser.reset();
+		for (size_t pos = 0; pos < body.size(); pos += fragment_size)
+			parser.parse(body.data() + pos, std::min(fragment_size, body.size() - pos), r);
+		entries = r.entry_count();
+	});
+	if (parser.done() == false)
+	{
+		std::printf("FAILED, the reply was not parsed to its end\n");
+		return 1;
+	}
+	std::printf("%zu bytes, %zu entries in %zu byte fragments: %.1f us, %.0f MB/s\n",
+		body.size(), entries, fragment_size, time, body.size() / time);
+	return 0;
+}
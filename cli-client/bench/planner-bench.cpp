@@ -0,0 +1,33 @@
+// Plans 500 random small reads of a 128 KiB domain at several gap thresholds,
+// reports the planning time and the byte amplification.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "nwaasioreadplanner.h"
+#include "bench.h"
+
+int main()
+{
+	const int repeats = 200;
+
+	std::mt19937 random(42);
+	std::uniform_int_distribution<uint32_t> address(0, 128 * 1024 - 16);
+	std::uniform_int_distribution<uint32_t> size(1, 8);
+	std::vector<nwaasio::read_planner::request> requests;
+	for (int i = 0; i < 500; i++)
+		requests.push_back({0, address(random), size(random)});
+
+	nwaasio::read_planner planner;
+	for (uint32_t gap : {0u, 16u, 64u, 256u})
+	{
+		planner.set_gap_threshold(gap);
+		double time = bench::best_microseconds(repeats, [&] {
+			planner.plan(requests);
+		});
+		const auto& stats = planner.statistics();
+		std::printf("gap %3u: %.1f us, %llu ranges in %llu commands, amplification %.2f\n", gap, time,
+			(unsigned long long)stats.ranges, (unsigned long long)stats.commands, stats.amplification());
+	}
+	return 0;
+}
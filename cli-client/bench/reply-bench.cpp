@@ -0,0 +1,63 @@
+// Compares the get() and records() lookups of a reply with the map() and map_list() copies.
+
+#include <cstdio>
+#include <string>
+#include "nwaasio.h"
+#include "nwaasioparser.h"
+#include "bench.h"
+
+static void fill_reply(nwaasio::reply& r, const std::string& body)
+{
+	nwaasio::ascii_parser parser;
+	parser.reset();
+	r.type = nwaasio::reply::reply_type::ASCII;
+	parser.parse(body.data(), body.size(), r);
+}
+
+
+int main()
+{
+	const int repeats = 20;
+	const int rounds = 1000;
+
+	nwaasio::reply info;
+	fill_reply(info, "name:snes9x\nversion:1.62\nnwa_version:1.0\nid:1\ncommands:EMULATOR_INFO,EMULATION_STATUS,CORE_READ,bCORE_WRITE\n\n");
+	double map_time = bench::best_microseconds(repeats, [&] {
+		for (int i = 0; i < rounds; i++)
+		{
+			auto values = info.map();
+			bench::sink = bench::sink + values["name"].size() + values["version"].size();
+		}
+	});
+	double get_time = bench::best_microseconds(repeats, [&] {
+		for (int i = 0; i < rounds; i++)
+			bench::sink = bench::sink + info.get("name").value_or("").size() + info.get("version").value_or("").size();
+	});
+	std::printf("two keys of a 5 entry reply: map() %.3f us, get() %.3f us\n", map_time / rounds, get_time / rounds);
+
+	// A list reply like CORES_LIST, a record starts each time name comes back
+	std::string body;
+	for (int i = 0; i < 64; i++)
+		body += "name:core" + std::to_string(i) + "\nplatform:SNES\nversion:1." + std::to_string(i) + "\nfile:core" + std::to_string(i) + ".so\n";
+	body += "\n";
+	nwaasio::reply list;
+	fill_reply(list, body);
+	double map_list_time = bench::best_microseconds(repeats, [&] {
+		for (int i = 0; i < rounds / 10; i++)
+		{
+			for (auto& record : list.map_list())
+				bench::sink = bench::sink + record["name"].size();
+		}
+	});
+	double records_time = bench::best_microseconds(repeats, [&] {
+		for (int i = 0; i < rounds / 10; i++)
+		{
+			// records() keeps its split, forget it to measure it each time
+			list._records_built = false;
+			for (auto record : list.records())
+				bench::sink = bench::sink + record.get("name").value_or("").size();
+		}
+	});
+	std::printf("names of a 64 record list: map_list() %.3f us, records() %.3f us\n", map_list_time / (rounds / 10), records_time / (rounds / 10));
+	return 0;
+}
@@ -2,10 +2,13 @@
 #include <iostream>
 #include <string>
 #include <iomanip>
+#include <cstring>
 #include <nwaasio.h>
 #include <nwaasioclient.h>
+#include <nwaasiocapture.h>
 
 nwaasio::client* client;
+nwaasio::stream_log_sink log_sink(std::cout, nwaasio::log_level::LWARNING);
 bool connected;
 asio::steady_timer* connect_timer;
 
@@ -19,12 +22,65 @@ void    read_command()
 
 void print_hex_dump(const uint8_t* buffer, const size_t offset, const size_t size)
 {
+    char line[16 * 3];
     for (unsigned int i = 0; i * 16 < size; i++)
     {
         auto m_size = std::min((size_t)16, size - i * 16);
-        std::cout << "    $" << std::hex << std::setw(2) << std::setfill('0') << offset + i * 16 << " | "
-            << nwaasio::buffer_to_hex(buffer + offset + i * 16, m_size, ".") << std::endl;
+        size_t line_size = nwaasio::buffer_to_hex_chars(buffer + offset + i * 16, m_size, line, '.');
+        std::cout << "    $" << std::hex << std::setw(2) << std::setfill('0') << offset + i * 16 << " | ";
+        std::cout.write(line, line_size) << '\n';
     }
+    std::cout.flush();
+}
+
+int decode_capture(const char* path, const char* filter)
+{
+    nwaasio::capture_reader reader;
+    if (reader.open(path) == false)
+    {
+        std::cerr << "Can't read capture file " << path << std::endl;
+        return 1;
+    }
+    nwaasio::capture_record record;
+    uint64_t first_timestamp = 0;
+    bool first = true;
+    while (reader.next(record))
+    {
+        if (first)
+            first_timestamp = record.timestamp;
+        first = false;
+        bool sent = record.dir == nwaasio::capture::direction::SENT;
+        if ((filter != nullptr && strcmp(filter, "--sent") == 0 && !sent)
+            || (filter != nullptr && strcmp(filter, "--received") == 0 && sent))
+            continue;
+        std::cout << std::dec << std::setfill(' ') << std::fixed << std::setprecision(3) << std::setw(12)
+            << (record.timestamp - first_timestamp) / 1e6 << "ms " << (sent ? ">> " : "<< ")
+            << record.data.size() << " bytes" << std::endl;
+        bool text = true;
+        for (uint8_t c : record.data)
+            text = text && (c == '\n' || (c >= 0x20 && c < 0x7F));
+        if (text)
+        {
+            std::string line;
+            for (uint8_t c : record.data)
+            {
+                if (c == '\n')
+                {
+                    std::cout << "    " << line << "\\n" << std::endl;
+                    line.clear();
+                }
+                else {
+                    line.push_back(c);
+                }
+            }
+            if (line.empty() == false)
+                std::cout << "    " << line << std::endl;
+        }
+        else {
+            print_hex_dump(record.data.data(), 0, record.data.size());
+        }
+    }
+    return 0;
 }
 
 void reconnect();
@@ -50,18 +106,33 @@ void reconnect()
     connect_timer->async_wait(connect_check_loop);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+    // nwa-cli --decode <file> [--sent|--received] print a capture made with nwa-cli --capture <file>
+    if (argc >= 3 && strcmp(argv[1], "--decode") == 0)
+        return decode_capture(argv[2], argc >= 4 ? argv[3] : nullptr);
     asio::io_service io_service;
     client = new nwaasio::client(io_service, "localhost", 0xBEEF);
-    client->show_trafic(true);
+    nwaasio::capture capture;
+    if (argc >= 3 && strcmp(argv[1], "--capture") == 0)
+    {
+        if (capture.open(argv[2]) == false)
+        {
+            std::cerr << "Can't create capture file " << argv[2] << std::endl;
+            return 1;
+        }
+        client->set_capture(&capture);
+    }
+    else {
+        client->show_trafic(true);
+    }
+    client->set_log_sink(&log_sink);
     connect_timer = new asio::steady_timer(io_service);
     std::cout << "Welcome to NWA cli client" << std::endl;
     client->set_connected_handler([] {
         connected = true;
         client->command("EMULATOR_INFO", [](const nwaasio::reply& reply) {
-            auto map = reply.map();
-            std::cout << "Connected to " << map["name"] << " " << map["version"] << std::endl;
+            std::cout << "Connected to " << reply.get("name").value_or("") << " " << reply.get("version").value_or("") << std::endl;
             std::cout << "Feel free to enter a command" << std::endl;
             read_command();
             });
@@ -81,20 +152,20 @@ int main()
     client->set_reply_handler([](const nwaasio::reply& reply) {
         if (reply.is_ascii())
         {
-            auto list_hash = reply.map_list();
-            if (list_hash.size() == 0)
+            auto records = reply.records();
+            if (records.size() == 0)
                 std::cout << "-ASCII reply : Ok" << std::endl;
-            if (list_hash.size() == 1)
+            if (records.size() == 1)
                 std::cout << "-ASCII reply : hash-" << std::endl;
-            if (list_hash.size() > 1)
+            if (records.size() > 1)
                 std::cout << "-ASCII reply : list-" << std::endl;
-            for (const auto& entry : list_hash)
+            for (const auto& record : records)
             {
-                for (const auto& hash : entry)
+                for (const auto& entry : record.entries())
                 {
-                    std::cout << "\t" << hash.first << " : " << hash.second << std::endl;
+                    std::cout << "\t" << entry.key << " : " << entry.value << std::endl;
                 }
-                if (list_hash.size() > 1)
+                if (records.size() > 1)
                     std::cout << "\t" << "---" << std::endl;
             }
         }
@@ -0,0 +1,212 @@
+// Counts the allocations of the client once its queues and buffers are warmed up.
+// A fake emulator answers on its own thread, only the allocations of the main thread are counted.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <asio/io_service.hpp>
+#include <asio/write.hpp>
+#include "nwaasioclient.h"
+
+static thread_local bool counting = false;
+static std::atomic<size_t> allocations{0};
+
+void* operator new(std::size_t size)
+{
+	if (counting)
+		allocations++;
+	void* p = std::malloc(size != 0 ? size : 1);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+
+// Answers EMULATION_STATUS, CORE_READ with zeroed data and anything else like EMULATOR_INFO
+class fake_emulator {
+public:
+	fake_emulator() : _acceptor(_io_service, tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+	{
+		_thread = std::thread([this] { _serve(); });
+	}
+	~fake_emulator()
+	{
+		_thread.join();
+	}
+	uint16_t port() const { return _acceptor.local_endpoint().port(); }
+
+private:
+	asio::io_service	_io_service;
+	tcp::acceptor		_acceptor;
+	std::thread			_thread;
+
+	void _serve()
+	{
+		tcp::socket socket(_io_service);
+		_acceptor.accept(socket);
+		std::string received;
+		char buffer[4096];
+		asio::error_code error;
+		while (true)
+		{
+			size_t size = socket.read_some(asio::buffer(buffer), error);
+			if (error)
+				return;
+			received.append(buffer, size);
+			size_t end;
+			while ((end = received.find('\n')) != std::string::npos)
+			{
+				std::string reply = _reply(received.substr(0, end));
+				received.erase(0, end + 1);
+				asio::write(socket, asio::buffer(reply), error);
+			}
+		}
+	}
+
+	static std::string _reply(const std::string& line)
+	{
+		if (line == "EMULATION_STATUS")
+			return "\nstate:running\ngame:test\n\n";
+		if (line.compare(0, 10, "CORE_READ ") != 0)
+			return "\nname:fake\nversion:1.0\n\n";
+		// The arguments are the domain then pairs of $address;$size
+		uint32_t size = 0;
+		size_t field = line.find(';');
+		for (bool is_size = false; field != std::string::npos; is_size = !is_size)
+		{
+			if (is_size)
+				size += (uint32_t) std::stoul(line.substr(field + 2), nullptr, 16);
+			field = line.find(';', field + 1);
+		}
+		std::string reply(5 + size, '\0');
+		reply[1] = (char) (size >> 24);
+		reply[2] = (char) (size >> 16);
+		reply[3] = (char) (size >> 8);
+		reply[4] = (char) size;
+		return reply;
+	}
+};
+
+
+// Sends commands on a few chains, a reply sends the next command of its chain,
+// the allocations are counted once warmup replies came
+class command_loop {
+public:
+	using send_function = std::function<void(int index, nwaasio::reply_callback callback)>;
+
+	command_loop(asio::io_service& io_service, int warmup, int count)
+		: _io_service(io_service), _warmup(warmup), _total(warmup + count) {}
+
+	// Return the number of allocations, or -1 if a command got an invalid reply
+	long run(int chains, send_function send)
+	{
+		_send = std::move(send);
+		_sent = 0;
+		_replied = 0;
+		_failed = false;
+		allocations = 0;
+		for (int i = 0; i < chains; i++)
+			_next();
+		_io_service.restart();
+		_io_service.run();
+		return _failed ? -1 : (long) allocations;
+	}
+
+private:
+	asio::io_service&	_io_service;
+	int					_warmup;
+	int					_total;
+	send_function		_send;
+	int					_sent = 0;
+	int					_replied = 0;
+	bool				_failed = false;
+
+	void _next()
+	{
+		if (_sent == _total)
+			return;
+		_send(_sent++, [this](nwaasio::reply&& r) {
+			if (r.type == nwaasio::reply::reply_type::INVALID)
+				_failed = true;
+			if (++_replied == _warmup)
+				counting = true;
+			if (_replied == _total)
+			{
+				counting = false;
+				_io_service.stop();
+				return;
+			}
+			_next();
+		});
+	}
+};
+
+
+int main()
+{
+	const int warmup = 2000;
+	const int count = 6000;
+	fake_emulator emulator;
+	asio::io_service io_service;
+	nwaasio::client client(io_service, "127.0.0.1", emulator.port());
+	client.set_connected_handler([&] { io_service.stop(); });
+	client.connect();
+	io_service.run();
+	client.set_pipeline_depth(4);
+
+	static uint8_t destination[0x40];
+	nwaasio::prepared_command ranges("CORE_READ", "WRAM;$0;$10;$100;$10;$200;$10;$300;$10");
+	command_loop loop(io_service, warmup, count);
+	auto short_commands = [&](int index, nwaasio::reply_callback callback) {
+		if (index % 3 == 0)
+			client.command("EMULATOR_INFO", std::move(callback));
+		else if (index % 3 == 1)
+			client.command("CORE_READ", "WRAM;$10;$40", std::move(callback));
+		else
+			client.read_into("CORE_READ", "WRAM;$10;$40", asio::buffer(destination), std::move(callback));
+	};
+	auto prepared_commands = [&](int index, nwaasio::reply_callback callback) {
+		if (index % 2 == 0)
+			client.command(ranges, std::move(callback));
+		else
+			client.read_into(ranges, asio::buffer(destination), std::move(callback));
+	};
+	const std::string long_name = "EMULATION_STATUS";
+	auto long_commands = [&](int, nwaasio::reply_callback callback) {
+		client.command(long_name, std::move(callback));
+	};
+
+	bool success = true;
+	auto check = [&](const char* name, long result, long expected_max) {
+		std::printf("%s: %ld allocations for %d commands\n", name, result, count);
+		if (result < 0 || result > expected_max)
+		{
+			std::printf("FAILED, expected at most %ld\n", expected_max);
+			success = false;
+		}
+	};
+	check("short commands", loop.run(4, short_commands), 0);
+	check("prepared commands with long arguments", loop.run(4, prepared_commands), 0);
+	client.set_write_coalescing(true);
+	check("coalesced short commands", loop.run(4, short_commands), 0);
+	client.set_write_coalescing(false);
+	// A name longer than the small string buffer is copied in the pending command and in the write frame
+	check("long command names", loop.run(4, long_commands), 2 * count);
+	return success ? 0 : 1;
+}
@@ -2,6 +2,10 @@
 #include <sstream>
 #include <iostream>
 #include <regex>
+#include <asio/bind_allocator.hpp>
+#include <asio/post.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
 #include "nwaasioclient.h"
 
 namespace nwaasio {
@@ -26,6 +30,16 @@ void client::show_trafic(bool t)
 	_show_trafic = t;
 }
 
+void client::set_log_sink(log_sink* sink)
+{
+	_log_sink = sink;
+}
+
+void client::set_capture(capture* c)
+{
+	_capture = c;
+}
+
 void client::set_connected_handler(std::function<void()> callback)
 {
 	_connected_callback = callback;
@@ -38,9 +52,9 @@ void client::set_connection_error_handler(std::function<void(const asio::error_c
 }
 
 
-void client::set_reply_handler(std::function<void(const nwaasio::reply&)> callback)
+void client::set_reply_handler(reply_callback callback)
 {
-	_general_reply_callback = callback;
+	_general_reply_callback = std::move(callback);
 }
 
 
@@ -50,22 +64,99 @@ void client::set_disconnected_handler(std::function<void()> callback)
 }
 
 
+void client::set_pipeline_depth(size_t depth)
+{
+	_pipeline_depth = std::max(depth, (size_t) 1);
+	_send_queued();
+}
+
+
+void client::set_write_coalescing(bool enabled, size_t threshold)
+{
+	_coalescing = enabled;
+	_coalescing_threshold = threshold;
+	if (enabled == false)
+		_flush_coalesced();
+}
+
+
 void client::raw_command(const std::string& raw)
 {
-	_state = NWAState::WAITING_REPLY;
-	_write_socket(raw + "\n");
+	_pending_command pending;
 	std::istringstream f(raw);
-	getline(f, _current_command, ' ');
+	getline(f, pending.command, ' ');
+	_submit(std::move(pending), _write_frame{raw, std::string()});
+}
+
+
+void client::command(const std::string& cmd, reply_callback callback)
+{
+	command(cmd, std::string(), std::move(callback));
 }
 
 
-void client::command(const std::string& cmd, std::function<void(const nwaasio::reply&)> callback)
+void client::command(const std::string& cmd, const std::list<std::string>& args, reply_callback callback)
 {
-	command(cmd, std::list<std::string>(), callback);
+	command(cmd, _join_arguments(args), std::move(callback));
 }
 
 
-void client::command(const std::string& cmd, const std::list<std::string>& args, std::function<void(const nwaasio::reply&)> callback)
+void client::command(const std::string& cmd, const std::string& args, reply_callback callback)
+{
+	_submit(_pending_command{cmd, std::move(callback)}, _write_frame{cmd, args});
+}
+
+
+void client::read_into(const std::string& cmd, const std::string& args, asio::mutable_buffer destination, reply_callback callback)
+{
+	_submit(_pending_command{cmd, std::move(callback), destination}, _write_frame{cmd, args});
+}
+
+
+void client::read_into(const std::string& cmd, const std::list<std::string>& args, asio::mutable_buffer destination, reply_callback callback)
+{
+	read_into(cmd, _join_arguments(args), destination, std::move(callback));
+}
+
+
+void client::binary_command(const std::string& cmd, const std::string& args, asio::const_buffer data, reply_callback callback)
+{
+	_write_frame frame{cmd, args};
+	uint32_t size = (uint32_t) data.size();
+	frame.binary = true;
+	frame.binary_header[0] = 0;
+	frame.binary_header[1] = (uint8_t) (size >> 24);
+	frame.binary_header[2] = (uint8_t) (size >> 16);
+	frame.binary_header[3] = (uint8_t) (size >> 8);
+	frame.binary_header[4] = (uint8_t) size;
+	frame.binary_data = data;
+	_submit(_pending_command{cmd, std::move(callback)}, std::move(frame));
+}
+
+
+void client::binary_command(const std::string& cmd, const std::list<std::string>& args, asio::const_buffer data, reply_callback callback)
+{
+	binary_command(cmd, _join_arguments(args), data, std::move(callback));
+}
+
+
+void client::command(const prepared_command& cmd, reply_callback callback)
+{
+	_write_frame frame;
+	frame.prepared = cmd._text;
+	_submit(_pending_command{cmd.name(), std::move(callback)}, std::move(frame));
+}
+
+
+void client::read_into(const prepared_command& cmd, asio::mutable_buffer destination, reply_callback callback)
+{
+	_write_frame frame;
+	frame.prepared = cmd._text;
+	_submit(_pending_command{cmd.name(), std::move(callback), destination}, std::move(frame));
+}
+
+
+std::string client::_join_arguments(const std::list<std::string>& args)
 {
 	std::string arguments;
 	for (const std::string& arg : args)
@@ -75,34 +166,191 @@ void client::command(const std::string& cmd, const std::list<std::string>& args,
 		else
 			arguments.append(";" + arg);
 	}
-	command(cmd, arguments, callback);
+	return arguments;
+}
+
+
+void client::_submit(_pending_command&& pending, _write_frame&& tosend)
+{
+	if (_state == NWAState::NOT_CONNECTED)
+	{
+		// Like a reply, the failure comes once the caller returns
+		asio::post(_io_service, [this, pending = std::move(pending)]() mutable {
+			_fail_command(std::move(pending), "not connected");
+		});
+		return;
+	}
+	if (_in_flight.size() >= _pipeline_depth || _queued.empty() == false)
+	{
+		_queued.emplace_back(std::move(pending), std::move(tosend));
+		return;
+	}
+	if (_state == NWAState::IDLE)
+		_state = NWAState::WAITING_REPLY;
+	_in_flight.push_back(std::move(pending));
+	_write_socket(std::move(tosend));
+}
+
+
+void client::_send_queued()
+{
+	while (_queued.empty() == false && _in_flight.size() < _pipeline_depth)
+	{
+		auto next = std::move(_queued.front());
+		_queued.pop_front();
+		if (_state == NWAState::IDLE)
+			_state = NWAState::WAITING_REPLY;
+		_in_flight.push_back(std::move(next.first));
+		_write_socket(std::move(next.second));
+	}
+}
+
+void client::_write_socket(_write_frame&& tosend)
+{
+	if (_show_trafic && tosend.prepared != nullptr)
+	{
+		std::cout << ">> " << *tosend.prepared << std::flush;
+	}
+	else if (_show_trafic)
+	{
+		std::cout << ">> " << tosend.command;
+		if (tosend.arguments.empty() == false)
+			std::cout << " " << tosend.arguments;
+		if (tosend.binary)
+			std::cout << " <" << tosend.binary_data.size() << " bytes of data>";
+		std::cout << std::endl;
+	}
+	// The data of a binary command is not copied in the batch, it goes after it
+	if (_coalescing && tosend.binary)
+		_flush_coalesced();
+	else if (_coalescing)
+	{
+		if (tosend.prepared != nullptr)
+		{
+			_coalescing_buffer.append(*tosend.prepared);
+		}
+		else
+		{
+			_coalescing_buffer.append(tosend.command);
+			if (tosend.arguments.empty() == false)
+			{
+				_coalescing_buffer.push_back(' ');
+				_coalescing_buffer.append(tosend.arguments);
+			}
+			if (tosend.raw == false)
+				_coalescing_buffer.push_back('\n');
+		}
+		_coalescing_count++;
+		if (_coalescing_buffer.size() >= _coalescing_threshold)
+		{
+			_flush_coalesced();
+		}
+		else if (_coalescing_flush_posted == false)
+		{
+			// This runs once the handler currently running returns
+			_coalescing_flush_posted = true;
+			asio::post(_io_service, asio::bind_allocator(handler_allocator<int>(_post_handler_memory), [this] {
+				_coalescing_flush_posted = false;
+				_flush_coalesced();
+			}));
+		}
+		return;
+	}
+	_write_queue.push_back(std::move(tosend));
+	if (_writing == false)
+		_start_write();
 }
 
 
-void client::command(const std::string& cmd, const std::string& args, std::function<void(const nwaasio::reply&)> callback)
+void client::_flush_coalesced()
 {
-	_current_command = cmd;
-	_state = NWAState::WAITING_REPLY;
-	if (args.empty() == false)
-		_write_socket(cmd + " " + args + "\n");
+	if (_coalescing_count == 0)
+		return;
+	_write_stats.flushes++;
+	_write_stats.commands += _coalescing_count;
+	_write_stats.bytes += _coalescing_buffer.size();
+	_write_stats.max_commands_per_flush = std::max(_write_stats.max_commands_per_flush, _coalescing_count);
+	_coalescing_count = 0;
+
+	_write_frame frame;
+	frame.command.swap(_coalescing_buffer);
+	_coalescing_buffer.swap(_coalescing_spare);
+	frame.raw = true;
+	_write_queue.push_back(std::move(frame));
+	if (_writing == false)
+		_start_write();
+}
+
+
+void client::_start_write()
+{
+	static const char separator = ' ';
+	static const char newline = '\n';
+	_current_write = std::move(_write_queue.front());
+	_write_queue.pop_front();
+	const _write_frame& frame = _current_write;
+
+	_write_buffers.clear();
+	if (frame.prepared != nullptr)
+	{
+		_write_buffers.push_back(asio::buffer(*frame.prepared));
+	}
 	else
-		_write_socket(cmd + "\n");
-	if (callback != nullptr)
-		_current_reply_callback = callback;
+	{
+		_write_buffers.push_back(asio::buffer(frame.command));
+		if (frame.arguments.empty() == false)
+		{
+			_write_buffers.push_back(asio::buffer(&separator, 1));
+			_write_buffers.push_back(asio::buffer(frame.arguments));
+		}
+		if (frame.raw == false)
+			_write_buffers.push_back(asio::buffer(&newline, 1));
+		if (frame.binary)
+		{
+			_write_buffers.push_back(asio::buffer(frame.binary_header));
+			_write_buffers.push_back(frame.binary_data);
+		}
+	}
+	if (_capture != nullptr)
+		_capture->record(capture::direction::SENT, _write_buffers.data(), _write_buffers.size());
+	_writing = true;
+	asio::async_write(_socket, buffer_sequence_view<asio::const_buffer>(_write_buffers.data(), _write_buffers.size()), asio::bind_allocator(handler_allocator<int>(_write_handler_memory),
+		std::bind(&nwaasio::client::_handle_write, this, std::placeholders::_1)));
 }
 
-void client::_write_socket(const std::string& tosend)
+
+void client::_handle_write(const asio::error_code& error)
 {
-	if (_show_trafic)
-		std::cout << ">> " << tosend << std::endl;
-	_socket.write_some(asio::buffer(tosend));
+	_writing = false;
+	// Let the prepared command be changed in place again
+	_current_write.prepared.reset();
+	// operation_aborted comes from _disconnected closing the socket, the queue can only hold
+	// frames submitted after connecting again
+	if (error && error != asio::error::operation_aborted)
+	{
+		// The commands after a failed write would get the replies of the ones before it
+		_disconnected();
+		return;
+	}
+	// Give back the memory of a coalesced batch for the next one
+	if (_current_write.raw)
+	{
+		std::string& free_buffer = _coalescing_buffer.empty() ? _coalescing_buffer : _coalescing_spare;
+		if (free_buffer.capacity() < _current_write.command.capacity())
+		{
+			free_buffer.swap(_current_write.command);
+			free_buffer.clear();
+		}
+	}
+	if (_write_queue.empty() == false)
+		_start_write();
 }
 
 
 void client::_attempt_connect(tcp::resolver::iterator endpoint_iter)
 {
-	_socket.async_connect(endpoint_iter->endpoint(), std::bind(&nwaasio::client::_handle_connect,
-		this, std::placeholders::_1, endpoint_iter));
+	_socket.async_connect(endpoint_iter->endpoint(), asio::bind_allocator(handler_allocator<int>(_connect_handler_memory),
+		std::bind(&nwaasio::client::_handle_connect, this, std::placeholders::_1, endpoint_iter)));
 }
 
 
@@ -111,6 +359,7 @@ void client::_handle_connect(const asio::error_code& error, tcp::resolver::resul
 	if (!error)
 	{
 		//std::cout << "Connected " << endpoint_iter->endpoint() << std::endl;
+		// _disconnected emptied _in_flight and _submit rejects the commands until now
 		_state = NWAState::IDLE;
 		if (_connected_callback)
 			_connected_callback();
@@ -126,7 +375,8 @@ void client::_handle_connect(const asio::error_code& error, tcp::resolver::resul
 
 void client::_set_async_read()
 {
-	_socket.async_read_some(asio::buffer(_read_buffer, 2048), std::bind(&nwaasio::client::_read_data, this, std::placeholders::_1, std::placeholders::_2));
+	_socket.async_read_some(asio::buffer(_read_buffer, 2048), asio::bind_allocator(handler_allocator<int>(_read_handler_memory),
+		std::bind(&nwaasio::client::_read_data, this, std::placeholders::_1, std::placeholders::_2)));
 }
 
 
@@ -137,17 +387,18 @@ static void print_ascii(const std::string& toprint)
 }
 
 
-void client::_ascii_reply_done()
+bool client::_ascii_reply_done()
 {
 	//std::cout << "ascii reply finished" << std::endl;
-	_state = NWAState::IDLE;
 	bool protocol_error = _current_reply.type == reply::reply_type::AERROR
 		&& _current_reply.error_type == error_type::PROTOCOL_ERROR;
-	_send_reply();
-	if (! protocol_error)
+	if (_log_sink != nullptr)
 	{
-		_set_async_read();
+		for (const ascii_entry& entry : _current_reply.entries())
+			NWAASIO_LOG(_log_sink, log_level::LTRACE, std::string(entry.key) + ":" + std::string(entry.value));
 	}
+	_send_reply();
+	return ! protocol_error;
 }
 
 
@@ -155,179 +406,187 @@ void client::_read_data(const asio::error_code& error, std::size_t bytes_transfe
 {
 	if (_show_trafic) {
 		std::cout << "<< Received data : " << bytes_transferred << std::endl;
-		if ((_state == NWAState::WAITING_REPLY && _read_buffer[0] == '\n')
+		if ((_state != NWAState::PROCESSING_REPLY && _read_buffer[0] == '\n')
 			|| (_state == NWAState::PROCESSING_REPLY && _current_reply.is_ascii()))
 			print_ascii(std::string(_read_buffer, bytes_transferred));
-		if ((_state == NWAState::WAITING_REPLY && _read_buffer[0] == 0)
+		if ((_state != NWAState::PROCESSING_REPLY && _read_buffer[0] == 0)
 			|| (_state == NWAState::PROCESSING_REPLY && _current_reply.is_binary()))
 			std::cout << "<< " << buffer_to_hex((uint8_t*)_read_buffer, bytes_transferred, " ") << std::endl;
 	}
+	if (error == asio::error::operation_aborted)
+		return;
 	if (bytes_transferred == 0)
 		_disconnected();
-	std::size_t pos = 0;
 	if (error)
 		return;
-	if (_state == NWAState::WAITING_REPLY)
+	if (_capture != nullptr)
+		_capture->record(capture::direction::RECEIVED, _read_buffer, bytes_transferred);
+	if (_parse_read_buffer(bytes_transferred))
+		_set_async_read();
+}
+
+
+bool client::_parse_read_buffer(std::size_t bytes_transferred)
+{
+	// A read can hold the end of a reply and any number of the following ones
+	std::size_t pos = 0;
+	while (pos != bytes_transferred)
 	{
-		_current_reply.command = _current_command;
-		// BINARY
-		if (_read_buffer[0] == 0)
-		{
-			_current_reply.type = reply::reply_type::BINARY;
-			pos = 1;
-			_binary_reply_offset = 0;
-			_binary_header_size = 0;
-		}
-		//ASCII
-		if (_read_buffer[0] == '\n')
+		if (_state != NWAState::PROCESSING_REPLY)
 		{
-			//std::cout << "ASCI REPLY" << std::endl;
-			_current_reply.type = reply::reply_type::ASCII;
-			if (bytes_transferred == 2 && _read_buffer[1] == '\n')
+			// Assigned, not built from a conditional, so a long name reuses the memory of the reply
+			if (_in_flight.empty())
+				_current_reply.command.clear();
+			else
+				_current_reply.command = _in_flight.front().command;
+			// BINARY
+			if (_read_buffer[pos] == 0)
 			{
-				//std::cout << "OK ASCI REPLY" << std::endl;
-				_state = NWAState::IDLE;
-				_send_reply();
-				_set_async_read();
-				return;
+				_current_reply.type = reply::reply_type::BINARY;
+				_binary_reply_offset = 0;
+				_binary_header_size = 0;
 			}
-			if (bytes_transferred > 2 && _read_buffer[1] == '\n')
+			//ASCII
+			else if (_read_buffer[pos] == '\n')
 			{
+				//std::cout << "ASCI REPLY" << std::endl;
+				_current_reply.type = reply::reply_type::ASCII;
+				_ascii_parser.reset();
+			}
+			else {
+				// We can't know where the next reply starts, drop what we received
 				_invalid_reply();
-				return;
+				return true;
 			}
-			pos = 1;
+			pos++;
+			_state = NWAState::PROCESSING_REPLY;
 		}
-		_state = NWAState::PROCESSING_REPLY;
-	}
-	if (_state == NWAState::PROCESSING_REPLY)
-	{
 		// BINARY
 		if (_current_reply.type == reply::reply_type::BINARY)
 		{
-			if (_binary_header_size != 4) 
+			if (_binary_header_size != 4)
 			{
 				//std::cout << "Handling binary header " << std::endl;
 				uint8_t copy_size = (uint8_t) std::min(bytes_transferred - pos, (size_t) (4 - _binary_header_size));
 				memcpy(_current_reply.binary_header + _binary_header_size, _read_buffer + pos, copy_size);
 				_binary_header_size += copy_size;
-				if (_binary_header_size == 4)
+				pos += copy_size;
+				if (_binary_header_size != 4)
+					return true;
+				_current_reply.binary_size = asio::detail::socket_ops::network_to_host_long(*((uint32_t*)(_current_reply.binary_header)));
+				NWAASIO_LOG(_log_sink, log_level::LDEBUG, "Binary size from header " + std::to_string(_current_reply.binary_size));
+				_binary_size_mismatch = false;
+				if (_in_flight.empty() == false && _in_flight.front().destination.data() != nullptr)
 				{
-					_current_reply.binary_size = asio::detail::socket_ops::network_to_host_long(*((uint32_t*)(_current_reply.binary_header)));
-					std::cout << "Binary size from header" << _current_reply.binary_size << std::endl;
-					_current_reply.binary_data = (uint8_t*)malloc(_current_reply.binary_size);
+					const asio::mutable_buffer& destination = _in_flight.front().destination;
+					if (destination.size() == _current_reply.binary_size)
+					{
+						_current_reply.binary_data = (uint8_t*)destination.data();
+					}
+					else {
+						// The payload still needs to be read to keep the stream in sync
+						_binary_size_mismatch = true;
+					}
 				}
-				if (_binary_header_size != 4 || bytes_transferred - pos == 4)
+				if (_current_reply.binary_data == nullptr)
 				{
-					_set_async_read();
-					return;
+					_current_reply.binary_payload = _payload_pool.allocate(_current_reply.binary_size);
+					_current_reply.binary_data = _current_reply.binary_payload.data();
 				}
-				pos += copy_size;
 			}
-			uint32_t cpy_size = std::min((uint32_t)(bytes_transferred - pos), _current_reply.binary_size - _binary_reply_offset);
+			// Only what was received with the header goes through the read buffer
+			uint32_t cpy_size = (uint32_t) std::min(bytes_transferred - pos, (size_t) (_current_reply.binary_size - _binary_reply_offset));
 			//std::cout << "Binary reply : cpy_size : " << cpy_size << std::endl;
-			if (cpy_size == 0)
-				return;
-			memcpy(_current_reply.binary_data + _binary_reply_offset, _read_buffer + pos, cpy_size);
+			if (cpy_size != 0)
+				memcpy(_current_reply.binary_data + _binary_reply_offset, _read_buffer + pos, cpy_size);
 			_binary_reply_offset += cpy_size;
+			pos += cpy_size;
 			//std::cout << "binarry offset " << _binary_reply_offset << std::endl;
 			if (_binary_reply_offset == _current_reply.binary_size)
 			{
-				_binary_reply_offset = 0;
-				_state = NWAState::IDLE;
-				_send_reply();
-				_set_async_read();
-				return;
+				_binary_reply_done();
+				continue;
 			}
+			// The rest of the payload is read straight into the reply data, the buffer is empty at this point
+			asio::async_read(_socket, asio::buffer(_current_reply.binary_data + _binary_reply_offset, _current_reply.binary_size - _binary_reply_offset),
+				asio::bind_allocator(handler_allocator<int>(_read_handler_memory),
+					std::bind(&nwaasio::client::_read_binary_payload, this, std::placeholders::_1, std::placeholders::_2)));
+			return false;
 		}
 		// ASCII
 		if (_current_reply.type == reply::reply_type::ASCII || _current_reply.type == reply::reply_type::AERROR)
 		{
-			unsigned int i = pos;
-			if (_read_buffer[i] == '\n' && _ascii_buffer.size() == 0
-				&& _current_reply._ascii_entries.size() != 0)
-			{
-				; /* It's to handle the case when we receive a single '\n'
-				  and it's the end of the ascii reply
-				 */
-				_ascii_reply_done();
-				return;
-			}
-			while (i != bytes_transferred)
-			{
-				for (; _read_buffer[i] != '\n' && i != bytes_transferred; i++)
-					;
-				if (_read_buffer[i] == '\n')
-				{
-					std::string entry = _ascii_buffer;
-					_ascii_buffer.clear();
-					entry.append(_read_buffer + pos, i - pos);
-					std::cout << entry << std::endl;
-					std::istringstream f(entry);
-					std::string key;
-					getline(f, key, ':');
-					std::string value;
-					getline(f, value, '\n');
-					//std::cout << "adding - " << key << ":" << value << std::endl;
-					if (key == "error")
-					{
-						_current_reply.type = reply::reply_type::AERROR;
-						if (value == "protocol_error")
-							_current_reply.error_type = error_type::PROTOCOL_ERROR;
-						if (value == "not_allowed")
-							_current_reply.error_type = error_type::NOT_ALLOWED;
-						if (value == "invalid_command")
-							_current_reply.error_type = error_type::INVALID_COMMAND;
-						if (value == "invalid_argument")
-							_current_reply.error_type = error_type::INVALID_ARGUMENT;
-						if (value == "command_error")
-							_current_reply.error_type = error_type::COMMAND_ERROR;
-					}
-					if (key == "reason" && _current_reply.type == reply::reply_type::AERROR)
-					{
-						_current_reply.error_reason = value;
-					}
-					if (_current_reply.type != reply::reply_type::AERROR)
-					{
-						_current_reply._ascii_entries.push_back(std::pair<std::string, std::string>(key, value));
-					}
-					pos = ++i;
-					//std::cout << "Pos after check " << pos << std::endl;
-				}
-				else {
-					_ascii_buffer.append(_read_buffer + pos, i - pos - 1);
-				}
-				if (i + 1 == bytes_transferred && _read_buffer[i] == '\n')
-				{
-					_ascii_reply_done();			
-					return;
-				}
-			}
+			pos += _ascii_parser.parse(_read_buffer + pos, bytes_transferred - pos, _current_reply);
+			if (_ascii_parser.done() && _ascii_reply_done() == false)
+				return false;
 		}
 	}
+	return true;
+}
+
+
+void client::_read_binary_payload(const asio::error_code& error, std::size_t bytes_transferred)
+{
+	if (_show_trafic)
+	{
+		std::cout << "<< Received data : " << bytes_transferred << std::endl;
+		std::cout << "<< " << buffer_to_hex(_current_reply.binary_data + _binary_reply_offset, bytes_transferred, " ") << std::endl;
+	}
+	if (error == asio::error::operation_aborted)
+		return;
+	if (error)
+	{
+		_reinit_reply();
+		_disconnected();
+		return;
+	}
+	if (_capture != nullptr)
+		_capture->record(capture::direction::RECEIVED, _current_reply.binary_data + _binary_reply_offset, bytes_transferred);
+	_binary_reply_done();
 	_set_async_read();
 }
 
 
+void client::_binary_reply_done()
+{
+	_binary_reply_offset = 0;
+	if (_binary_size_mismatch)
+	{
+		_current_reply.error_reason = "binary reply size " + std::to_string(_current_reply.binary_size)
+			+ " does not match the destination size " + std::to_string(_in_flight.front().destination.size());
+		_current_reply.type = reply::reply_type::INVALID;
+		_binary_size_mismatch = false;
+	}
+	_send_reply();
+}
+
 
 inline void client::_send_reply()
 {
-	if (_current_reply_callback != nullptr)
+	reply_callback callback = nullptr;
+	if (_in_flight.empty() == false)
+	{
+		callback = std::move(_in_flight.front().callback);
+		_in_flight.pop_front();
+	}
+	_state = _in_flight.empty() ? NWAState::IDLE : NWAState::WAITING_REPLY;
+	// The callback can take the reply, _reinit_reply makes it usable again
+	if (callback != nullptr)
 	{
-		_current_reply_callback(_current_reply);
-		_current_reply_callback = nullptr;
+		callback(std::move(_current_reply));
 	}
 	else if (_general_reply_callback != nullptr)
 	{
-		_general_reply_callback(_current_reply);
+		_general_reply_callback(std::move(_current_reply));
 	}
 	_reinit_reply();
+	_send_queued();
 }
 
 
 void	client::_invalid_reply()
 {
-	std::cout << "INVALID REPLY" << std::endl;
+	NWAASIO_LOG(_log_sink, log_level::LWARNING, "Invalid reply to " + _current_reply.command);
 	_current_reply.type = reply::reply_type::INVALID;
 	_send_reply();
 	//_socket.close();
@@ -336,23 +595,58 @@ void	client::_invalid_reply()
 
 inline void client::_reinit_reply()
 {
-	if (_current_reply.binary_data != nullptr)
-	{
-		free(_current_reply.binary_data);
-		_current_reply.binary_data = nullptr;
-	}
+	_current_reply.binary_payload.reset();
+	_current_reply.binary_data = nullptr;
 	_current_reply.binary_size = 0;
 	_current_reply.type = reply::reply_type::INVALID;
-	_current_reply._ascii_entries.clear();
+	_current_reply.error_reason.clear();
+	_current_reply._clear_ascii_entries();
 }
 
 
 inline void client::_disconnected()
 {
+	// A write error and a read error can both report the loss of the same connection
+	if (_state == NWAState::NOT_CONNECTED)
+		return;
+	_state = NWAState::NOT_CONNECTED;
+	fifo<_pending_command> in_flight;
+	fifo<std::pair<_pending_command, _write_frame> > queued;
+	std::swap(in_flight, _in_flight);
+	std::swap(queued, _queued);
+	_coalescing_buffer.clear();
+	_coalescing_count = 0;
+	_write_queue.clear();
+	// A reply cut by the disconnection must not leak into the first reply after reconnecting
+	_reinit_reply();
+	_ascii_parser.reset();
+	_binary_reply_offset = 0;
+	_binary_header_size = 0;
+	_binary_size_mismatch = false;
+	// connect opens a new socket if this one is closed
+	asio::error_code ignored;
+	_socket.close(ignored);
+	// The commands the callbacks submit are rejected, nothing is left for the next connection
+	for (; in_flight.empty() == false; in_flight.pop_front())
+		_fail_command(std::move(in_flight.front()), "disconnected");
+	for (; queued.empty() == false; queued.pop_front())
+		_fail_command(std::move(queued.front().first), "disconnected");
 	if (_disconnected_callback != nullptr)
 		_disconnected_callback();
 }
 
 
+void client::_fail_command(_pending_command&& pending, const char* reason)
+{
+	reply failed;
+	failed.command = std::move(pending.command);
+	failed.error_reason = reason;
+	if (pending.callback != nullptr)
+		pending.callback(std::move(failed));
+	else if (_general_reply_callback != nullptr)
+		_general_reply_callback(std::move(failed));
+}
+
+
 
 }
\ No newline at end of file
@@ -1,8 +1,9 @@
-#include <sstream>
-#include <iomanip>
 #include <cstdint>
+#include <cstring>
 #include <cassert>
+#include <stdexcept>
 #include "nwaasio.h"
+#include "nwaasiosimd.h"
 
 std::string nwaasio::error_type_string(error_type err)
 {
@@ -27,24 +28,256 @@ std::string nwaasio::error_type_string(error_type err)
 #endif
 }
 
+static const char hex_digits[] = "0123456789ABCDEF";
+
 std::string nwaasio::buffer_to_hex(const uint8_t* data, size_t size, const std::string sep)
 {
-	std::ostringstream f;
+	std::string toret;
+	if (sep.size() <= 1)
+	{
+		toret.resize(hex_size(size, sep.size() == 1));
+		buffer_to_hex_chars(data, size, &toret[0], sep.empty() ? 0 : sep[0]);
+		return toret;
+	}
+	toret.reserve(size * (2 + sep.size()));
 	for (size_t i = 0; i < size; i++)
 	{
-		f << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+		toret.push_back(hex_digits[data[i] >> 4]);
+		toret.push_back(hex_digits[data[i] & 0xF]);
+		if (i + 1 != size)
+			toret.append(sep);
+	}
+	return toret;
+}
+
+#if defined(NWAASIO_USE_SSSE3)
+// The 16 bytes give 32 hex chars, high_half selects the 16 to return
+static inline __m128i hex_chars(__m128i bytes, bool high_half)
+{
+	const __m128i digits = _mm_loadu_si128((const __m128i*)hex_digits);
+	const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+	__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask));
+	__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, nibble_mask));
+	return high_half ? _mm_unpackhi_epi8(hi, lo) : _mm_unpacklo_epi8(hi, lo);
+}
+#endif
+
+size_t nwaasio::buffer_to_hex_chars(const uint8_t* data, size_t size, char* out, char sep)
+{
+	char* start = out;
+	size_t i = 0;
+	if (sep == 0)
+	{
+#if defined(NWAASIO_USE_AVX2)
+		const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hex_digits));
+		const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+		for (; size - i >= 32; i += 32, out += 64)
+		{
+			__m256i bytes = _mm256_loadu_si256((const __m256i*)(data + i));
+			__m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble_mask));
+			__m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, nibble_mask));
+			// unpack works per 128 bits lane, put the lanes back in order when storing
+			__m256i first = _mm256_unpacklo_epi8(hi, lo);
+			__m256i second = _mm256_unpackhi_epi8(hi, lo);
+			_mm256_storeu_si256((__m256i*)out, _mm256_permute2x128_si256(first, second, 0x20));
+			_mm256_storeu_si256((__m256i*)(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+		}
+#endif
+#if defined(NWAASIO_USE_SSSE3)
+		for (; size - i >= 16; i += 16, out += 32)
+		{
+			__m128i bytes = _mm_loadu_si128((const __m128i*)(data + i));
+			_mm_storeu_si128((__m128i*)out, hex_chars(bytes, false));
+			_mm_storeu_si128((__m128i*)(out + 16), hex_chars(bytes, true));
+		}
+#endif
+		for (; i < size; i++)
+		{
+			*out++ = hex_digits[data[i] >> 4];
+			*out++ = hex_digits[data[i] & 0xF];
+		}
+		return out - start;
+	}
+#if defined(NWAASIO_USE_SSSE3)
+	// 8 bytes give 16 hex chars spread on 24 chars, the 0x80 indexes are where the separator goes
+	const __m128i spread_first = _mm_setr_epi8(0, 1, -128, 2, 3, -128, 4, 5, -128, 6, 7, -128, 8, 9, -128, 10);
+	const __m128i spread_second = _mm_setr_epi8(11, -128, 12, 13, -128, 14, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+	const __m128i separators_first = _mm_andnot_si128(_mm_cmpgt_epi8(spread_first, _mm_set1_epi8(-1)), _mm_set1_epi8(sep));
+	const __m128i separators_second = _mm_andnot_si128(_mm_cmpgt_epi8(spread_second, _mm_set1_epi8(-1)), _mm_set1_epi8(sep));
+	// The last separator of a block of 8 is written as the first char of the second store
+	for (; size - i > 8; i += 8, out += 24)
+	{
+		__m128i chars = hex_chars(_mm_loadl_epi64((const __m128i*)(data + i)), false);
+		_mm_storeu_si128((__m128i*)out, _mm_or_si128(_mm_shuffle_epi8(chars, spread_first), separators_first));
+		__m128i second = _mm_or_si128(_mm_shuffle_epi8(chars, spread_second), separators_second);
+		memcpy(out + 16, &second, 8);
+	}
+#endif
+	for (; i < size; i++)
+	{
+		*out++ = hex_digits[data[i] >> 4];
+		*out++ = hex_digits[data[i] & 0xF];
 		if (i + 1 != size)
-			f << sep;
+			*out++ = sep;
+	}
+	return out - start;
+}
+
+size_t nwaasio::number_to_hex_chars(uint64_t value, char* out)
+{
+	char digits[16];
+	size_t count = 0;
+	do {
+		digits[15 - count++] = hex_digits[value & 0xF];
+		value >>= 4;
+	} while (value != 0);
+	memcpy(out, digits + 16 - count, count);
+	return count;
+}
+
+void nwaasio::append_hex_argument(std::string& text, uint64_t value)
+{
+	char digits[16];
+	text.push_back('$');
+	text.append(digits, number_to_hex_chars(value, digits));
+}
+
+bool nwaasio::hex_to_buffer(std::string_view hex, uint8_t* out)
+{
+	// 0xFF for the chars that are not hex digits
+	static const struct hex_table {
+		uint8_t values[256];
+		hex_table()
+		{
+			memset(values, 0xFF, sizeof(values));
+			for (int i = 0; i < 10; i++)
+				values['0' + i] = (uint8_t)i;
+			for (int i = 0; i < 6; i++)
+			{
+				values['A' + i] = (uint8_t)(10 + i);
+				values['a' + i] = (uint8_t)(10 + i);
+			}
+		}
+	} table;
+	if (hex.size() % 2 != 0)
+		return false;
+	uint8_t invalid = 0;
+	for (size_t i = 0; i < hex.size(); i += 2)
+	{
+		uint8_t hi = table.values[(uint8_t)hex[i]];
+		uint8_t lo = table.values[(uint8_t)hex[i + 1]];
+		invalid |= (hi | lo) & 0xF0;
+		*out++ = (uint8_t)((hi << 4) | (lo & 0x0F));
+	}
+	return invalid == 0;
+}
+
+nwaasio::reply::reply(reply&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+nwaasio::reply& nwaasio::reply::operator=(reply&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+	command = std::move(other.command);
+	type = other.type;
+	error_type = other.error_type;
+	error_reason = std::move(other.error_reason);
+	memcpy(binary_header, other.binary_header, sizeof(binary_header));
+	// binary_data points either to the payload memory, which moves with it, or to a buffer of the caller
+	binary_data = other.binary_data;
+	binary_size = other.binary_size;
+	binary_payload = std::move(other.binary_payload);
+	_ascii_text = std::move(other._ascii_text);
+	_ascii_index = std::move(other._ascii_index);
+	_record_starts = std::move(other._record_starts);
+	_records_built = other._records_built;
+
+	// The moved from reply must not look like it still has the data
+	other.command.clear();
+	other.type = reply_type::INVALID;
+	other.error_reason.clear();
+	other.binary_data = nullptr;
+	other.binary_size = 0;
+	other._clear_ascii_entries();
+	other._record_starts.clear();
+	return *this;
+}
+
+nwaasio::ascii_entry nwaasio::reply::entry(size_t index) const
+{
+	const _ascii_offsets& offsets = _ascii_index[index];
+	std::string_view text(_ascii_text);
+	return ascii_entry{
+		text.substr(offsets.begin, offsets.separator - offsets.begin),
+		offsets.separator == offsets.end ? std::string_view() : text.substr(offsets.separator + 1, offsets.end - offsets.separator - 1)
+	};
+}
+
+std::optional<std::string_view> nwaasio::reply::get(std::string_view key) const
+{
+	return record{this, 0, _ascii_index.size()}.get(key);
+}
+
+std::optional<std::string_view> nwaasio::reply::record::get(std::string_view key) const
+{
+	for (size_t i = _last; i != _first; i--)
+	{
+		ascii_entry entry = _reply->entry(i - 1);
+		if (entry.key == key)
+			return entry.value;
+	}
+	return std::nullopt;
+}
+
+nwaasio::reply::record_range nwaasio::reply::records() const
+{
+	if (_records_built == false)
+	{
+		_record_starts.clear();
+		for (size_t i = 0; i < _ascii_index.size(); i++)
+		{
+			// Same rule as map_list, a key already in the current record starts a new one
+			if (_record_starts.empty() || record{this, _record_starts.back(), i}.get(entry(i).key).has_value())
+				_record_starts.push_back((uint32_t)i);
+		}
+		_records_built = true;
 	}
-	return f.str();
+	return record_range{record_iterator(this, 0), record_iterator(this, _record_starts.size()), _record_starts.size()};
+}
+
+nwaasio::reply::record nwaasio::reply::_record(size_t index) const
+{
+	size_t last = index + 1 == _record_starts.size() ? _ascii_index.size() : _record_starts[index + 1];
+	return record{this, _record_starts[index], last};
+}
+
+void nwaasio::reply::_add_ascii_entry(uint32_t begin, uint32_t separator)
+{
+	_ascii_offsets offsets;
+	offsets.begin = begin;
+	offsets.separator = separator;
+	offsets.end = (uint32_t)_ascii_text.size();
+	_ascii_text.push_back('\n');
+	_ascii_index.push_back(offsets);
+	_records_built = false;
+}
+
+void nwaasio::reply::_clear_ascii_entries()
+{
+	_ascii_text.clear();
+	_ascii_index.clear();
+	_records_built = false;
 }
 
 std::map<std::string, std::string> nwaasio::reply::map() const
 {
 	std::map<std::string, std::string> toret;
-	for (auto& pair : _ascii_entries)
+	for (const ascii_entry& entry : entries())
 	{
-		toret[pair.first] = pair.second;
+		toret[std::string(entry.key)] = entry.value;
 	}
 	return toret;
 }
@@ -53,10 +286,10 @@ std::list<std::map<std::string, std::string>> nwaasio::reply::map_list() const
 {
 	std::list<std::map<std::string, std::string> > toret;
 	auto it = toret.begin();
-	for (auto& pair : _ascii_entries)
+	for (const ascii_entry& entry : entries())
 	{
-		const std::string& key = pair.first;
-		const std::string& value = pair.second;
+		std::string key(entry.key);
+		const std::string_view& value = entry.value;
 		if (toret.begin() == toret.end()) // for an empty list
 		{
 			toret.push_front(std::map<std::string, std::string>());
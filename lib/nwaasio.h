@@ -2,7 +2,11 @@
 #include <cstdint>
 #include <list>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
+#include "nwaasiobuffer.h"
 
 namespace nwaasio {
     enum class error_type {
@@ -14,13 +18,52 @@ namespace nwaasio {
     };
     std::string error_type_string(error_type err);
     std::string buffer_to_hex(const uint8_t* data, size_t size, const std::string sep = "");
+    /**
+     * @brief The number of chars buffer_to_hex_chars writes for size bytes
+     */
+    inline size_t hex_size(size_t size, bool with_separator) { return size == 0 ? 0 : size * (with_separator ? 3 : 2) - (with_separator ? 1 : 0); }
+    /**
+     * @brief Write the uppercase hex of data in out, without allocating anything
+     * @param out Must hold at least hex_size(size, sep != 0) chars, no '\0' is added
+     * @param sep The char to put between each byte, 0 for none
+     * @return The number of chars written
+     */
+    size_t buffer_to_hex_chars(const uint8_t* data, size_t size, char* out, char sep = 0);
+    /**
+     * @brief Write a number in uppercase hex without leading zeros, like 1F
+     * @param out Must hold at least 16 chars, no '\0' is added
+     * @return The number of chars written
+     */
+    size_t number_to_hex_chars(uint64_t value, char* out);
+    /**
+     * @brief Append a number to the arguments of a command, in uppercase hex with a $ like $1F
+     */
+    void append_hex_argument(std::string& text, uint64_t value);
+    /**
+     * @brief Decode an hex string (upper or lower case, without separator)
+     * @param out Must hold at least hex.size() / 2 bytes
+     * @return false if hex has an odd size or a char that is not an hex digit
+     */
+    bool hex_to_buffer(std::string_view hex, uint8_t* out);
+    /**
+     * @brief A key/value entry of an ascii reply, the views point into the reply storage
+     */
+    struct ascii_entry {
+        std::string_view key;
+        std::string_view value;
+    };
     /**
      * @brief This represent a reply from a command, before using the data from it, it's
      * recommanded that you check the type using the is_** method.
      * 
-     * To access the data from an ascii reply use the map() or map_list() method
-     * To access the data from a binary data, use the binary_data member
+     * To access the data from an ascii reply use the get(), entries() or records() method,
+     * map() and map_list() do the same but copy everything in new containers
+     * To access the data from a binary data, use the binary_data member, when the reply was
+     * read into a buffer you provided, binary_data points to it. Otherwise the data is owned by
+     * binary_payload, keep a copy of it if you need the data after the callback
      * To access the data from an error reply use error_type and error_reason member
+     *
+     * A reply can't be copied, but it can be moved with its data and entries
      */
     struct reply {
         enum class reply_type {
@@ -29,6 +72,15 @@ namespace nwaasio {
             ASCII,
             BINARY,
         };
+        reply() = default;
+        reply(const reply&) = delete;
+        reply& operator=(const reply&) = delete;
+        /**
+         * @brief Take the data and the entries of other, other is left an empty INVALID reply
+         */
+        reply(reply&& other) noexcept;
+        reply& operator=(reply&& other) noexcept;
+
         std::string	command;
         reply_type	type = reply_type::INVALID;
 
@@ -37,19 +89,108 @@ namespace nwaasio {
         std::map<std::string, std::string> map() const;
         std::list<std::map<std::string, std::string> > map_list() const;
 
+        class entry_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = ascii_entry;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const ascii_entry*;
+            using reference = ascii_entry;
+
+            entry_iterator(const reply* r, size_t index) : _reply(r), _index(index) {}
+            ascii_entry operator*() const { return _reply->entry(_index); }
+            entry_iterator& operator++() { _index++; return *this; }
+            entry_iterator operator++(int) { entry_iterator copy = *this; _index++; return copy; }
+            bool operator==(const entry_iterator& other) const { return _index == other._index; }
+            bool operator!=(const entry_iterator& other) const { return _index != other._index; }
+        private:
+            const reply*	_reply;
+            size_t			_index;
+        };
+        struct entry_range {
+            entry_iterator	first;
+            entry_iterator	last;
+            entry_iterator begin() const { return first; }
+            entry_iterator end() const { return last; }
+        };
+        /**
+         * @brief Iterate over the entries of an ascii reply in the order they were received
+         */
+        entry_range entries() const { return entry_range{entry_iterator(this, 0), entry_iterator(this, _ascii_index.size())}; }
+        size_t entry_count() const { return _ascii_index.size(); }
+        ascii_entry entry(size_t index) const;
+        /**
+         * @brief Get the value of a key of an ascii reply, like map() the last entry with this key wins
+         */
+        std::optional<std::string_view> get(std::string_view key) const;
+
+        /**
+         * @brief A group of entries of a list reply, like an element of map_list()
+         */
+        struct record {
+            const reply*	_reply;
+            size_t			_first;
+            size_t			_last;
+            std::optional<std::string_view> get(std::string_view key) const;
+            entry_range entries() const { return entry_range{entry_iterator(_reply, _first), entry_iterator(_reply, _last)}; }
+            size_t size() const { return _last - _first; }
+        };
+        class record_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = record;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const record*;
+            using reference = record;
+
+            record_iterator(const reply* r, size_t index) : _reply(r), _index(index) {}
+            record operator*() const { return _reply->_record(_index); }
+            record_iterator& operator++() { _index++; return *this; }
+            record_iterator operator++(int) { record_iterator copy = *this; _index++; return copy; }
+            bool operator==(const record_iterator& other) const { return _index == other._index; }
+            bool operator!=(const record_iterator& other) const { return _index != other._index; }
+        private:
+            const reply*	_reply;
+            size_t			_index;
+        };
+        struct record_range {
+            record_iterator	first;
+            record_iterator	last;
+            size_t			count;
+            record_iterator begin() const { return first; }
+            record_iterator end() const { return last; }
+            size_t size() const { return count; }
+        };
+        /**
+         * @brief Iterate over the records of a list reply, a new record starts when a key is repeated
+         * The split is done on the first call and kept until the reply is reused
+         */
+        record_range records() const;
+
         uint8_t		binary_header[4];
         uint8_t*	binary_data = nullptr;
-        uint32_t	binary_size;
+        uint32_t	binary_size = 0;
+        payload		binary_payload;
 
         bool is_binary() const { return type == reply_type::BINARY; }
         bool is_ascii() const { return type == reply_type::ASCII; }
         bool is_error() const { return type == reply_type::AERROR; }
         bool is_valid() const { return type != reply_type::INVALID; }
 
-        std::list<std::pair<std::string, std::string> > _ascii_entries;
-        ~reply() {
-            if (binary_data != nullptr)
-                free(binary_data);
-        }
+        // The ascii entries are stored as the raw lines of the reply, with an offset table
+        struct _ascii_offsets {
+            uint32_t begin;
+            uint32_t separator;
+            uint32_t end;
+        };
+        std::string					_ascii_text;
+        std::vector<_ascii_offsets>	_ascii_index;
+        // Index of the first entry of each record, built by records()
+        mutable std::vector<uint32_t>	_record_starts;
+        mutable bool					_records_built = false;
+        // Add the line from begin to the end of _ascii_text as an entry
+        void _add_ascii_entry(uint32_t begin, uint32_t separator);
+        void _clear_ascii_entries();
+        record _record(size_t index) const;
     };
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "nwaasiobuffer.h"
+
+namespace nwaasio {
+
+// Size classes go from 64 bytes to 16 MiB, bigger blocks are not cached
+static const unsigned int min_class_shift = 6;
+static const unsigned int class_count = 19;
+static const uint8_t unpooled_class = 0xFF;
+
+struct payload::block {
+	std::atomic<uint32_t>					refs;
+	uint8_t									size_class;
+	size_t									size;
+	std::shared_ptr<buffer_pool::core>		owner;
+
+	static size_t header_size() { return (sizeof(block) + 15) & ~(size_t)15; }
+	uint8_t* data() { return (uint8_t*)this + header_size(); }
+};
+
+struct buffer_pool::core {
+	std::mutex									mutex;
+	std::vector<payload::block*>				free_blocks[class_count];
+	size_t										max_cached_bytes;
+	bool										closed = false;
+	stats										counters;
+
+	static size_t capacity(uint8_t size_class) { return (size_t)1 << (size_class + min_class_shift); }
+
+	static payload::block* create(uint8_t size_class, size_t size)
+	{
+		size_t data_size = size_class == unpooled_class ? size : capacity(size_class);
+		void* memory = ::operator new(payload::block::header_size() + data_size);
+		payload::block* b = new (memory) payload::block;
+		b->size_class = size_class;
+		b->size = size;
+		return b;
+	}
+
+	static void destroy(payload::block* b)
+	{
+		b->~block();
+		::operator delete((void*)b);
+	}
+
+	void release(payload::block* b)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (closed == false && b->size_class != unpooled_class
+				&& counters.cached_bytes + capacity(b->size_class) <= max_cached_bytes)
+			{
+				counters.cached_blocks++;
+				counters.cached_bytes += capacity(b->size_class);
+				free_blocks[b->size_class].push_back(b);
+				return;
+			}
+		}
+		destroy(b);
+	}
+
+	void clear()
+	{
+		std::vector<payload::block*> to_destroy;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& blocks : free_blocks)
+			{
+				to_destroy.insert(to_destroy.end(), blocks.begin(), blocks.end());
+				blocks.clear();
+			}
+			counters.cached_blocks = 0;
+			counters.cached_bytes = 0;
+		}
+		for (payload::block* b : to_destroy)
+			destroy(b);
+	}
+};
+
+
+payload::payload(const payload& other) : _block(other._block)
+{
+	if (_block != nullptr)
+		_block->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+payload::payload(payload&& other) noexcept : _block(other._block)
+{
+	other._block = nullptr;
+}
+
+
+payload& payload::operator=(const payload& other)
+{
+	if (this != &other)
+	{
+		payload copy(other);
+		std::swap(_block, copy._block);
+	}
+	return *this;
+}
+
+
+payload& payload::operator=(payload&& other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		std::swap(_block, other._block);
+	}
+	return *this;
+}
+
+
+payload::~payload()
+{
+	reset();
+}
+
+
+uint8_t* payload::data() const
+{
+	return _block != nullptr ? _block->data() : nullptr;
+}
+
+
+size_t payload::size() const
+{
+	return _block != nullptr ? _block->size : 0;
+}
+
+
+void payload::reset()
+{
+	if (_block == nullptr)
+		return;
+	block* b = _block;
+	_block = nullptr;
+	if (b->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+	std::shared_ptr<buffer_pool::core> owner = std::move(b->owner);
+	if (owner != nullptr)
+		owner->release(b);
+	else
+		buffer_pool::core::destroy(b);
+}
+
+
+buffer_pool::buffer_pool(size_t max_cached_bytes) : _core(std::make_shared<core>())
+{
+	_core->max_cached_bytes = max_cached_bytes;
+}
+
+
+buffer_pool::~buffer_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_core->mutex);
+		_core->closed = true;
+	}
+	_core->clear();
+}
+
+
+payload buffer_pool::allocate(size_t size)
+{
+	uint8_t size_class = 0;
+	while (size_class < class_count && core::capacity(size_class) < size)
+		size_class++;
+	payload::block* b = nullptr;
+	if (size_class == class_count)
+		size_class = unpooled_class;
+	{
+		std::lock_guard<std::mutex> lock(_core->mutex);
+		if (size_class != unpooled_class && _core->free_blocks[size_class].empty() == false)
+		{
+			b = _core->free_blocks[size_class].back();
+			_core->free_blocks[size_class].pop_back();
+			_core->counters.cached_blocks--;
+			_core->counters.cached_bytes -= core::capacity(size_class);
+			_core->counters.hits++;
+		}
+		else {
+			_core->counters.misses++;
+		}
+	}
+	if (b == nullptr)
+		b = core::create(size_class, size);
+	b->size = size;
+	b->refs.store(1, std::memory_order_relaxed);
+	b->owner = _core;
+	return payload(b);
+}
+
+
+buffer_pool::stats buffer_pool::statistics() const
+{
+	std::lock_guard<std::mutex> lock(_core->mutex);
+	return _core->counters;
+}
+
+
+void buffer_pool::trim()
+{
+	_core->clear();
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace nwaasio {
+    class buffer_pool;
+    /**
+     * @brief A reference counted handle on a block of data allocated by a buffer_pool
+     *
+     * Copying a payload does not copy the data, the block goes back to its pool when the
+     * last handle on it is destroyed. A payload can outlive the pool that allocated it.
+     */
+    class payload {
+    public:
+        payload() = default;
+        payload(const payload& other);
+        payload(payload&& other) noexcept;
+        payload& operator=(const payload& other);
+        payload& operator=(payload&& other) noexcept;
+        ~payload();
+
+        uint8_t*	data() const;
+        size_t		size() const;
+        bool		empty() const { return size() == 0; }
+        explicit operator bool() const { return _block != nullptr; }
+        /**
+         * @brief Release the handle on the data
+         */
+        void		reset();
+
+    private:
+        friend class buffer_pool;
+        struct block;
+        explicit payload(block* b) : _block(b) {}
+        block* _block = nullptr;
+    };
+
+    /**
+     * @brief A pool of data blocks sorted by power of two size classes
+     *
+     * Released blocks are kept to be reused by the next allocations of the same size class,
+     * up to max_cached_bytes. Blocks can be released from any thread.
+     */
+    class buffer_pool {
+    public:
+        struct stats {
+            uint64_t	hits = 0;
+            uint64_t	misses = 0;
+            uint64_t	cached_blocks = 0;
+            uint64_t	cached_bytes = 0;
+        };
+        /**
+         * @brief Create a pool
+         * @param max_cached_bytes The maximum memory kept for released blocks
+         */
+        explicit buffer_pool(size_t max_cached_bytes = 16 * 1024 * 1024);
+        ~buffer_pool();
+        buffer_pool(const buffer_pool&) = delete;
+        buffer_pool& operator=(const buffer_pool&) = delete;
+
+        /**
+         * @brief Get a block of at least size bytes, the content is not initialized
+         */
+        payload	allocate(size_t size);
+        /**
+         * @brief Get the hit/miss counters and what is currently cached
+         */
+        stats	statistics() const;
+        /**
+         * @brief Free all the cached blocks
+         */
+        void	trim();
+
+    private:
+        friend class payload;
+        struct core;
+        std::shared_ptr<core> _core;
+    };
+}
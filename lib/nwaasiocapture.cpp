@@ -0,0 +1,162 @@
+#include <chrono>
+#include <cstring>
+#include "nwaasiocapture.h"
+
+namespace nwaasio {
+
+static const char capture_magic[8] = {'N', 'W', 'A', 'C', 'A', 'P', '1', '\0'};
+static const size_t record_header_size = 16;
+
+static void store_le(uint8_t* to, uint64_t value, unsigned int size)
+{
+	for (unsigned int i = 0; i < size; i++)
+		to[i] = (uint8_t)(value >> (i * 8));
+}
+
+static uint64_t load_le(const uint8_t* from, unsigned int size)
+{
+	uint64_t value = 0;
+	for (unsigned int i = 0; i < size; i++)
+		value |= (uint64_t)from[i] << (i * 8);
+	return value;
+}
+
+
+capture::capture(size_t ring_size)
+{
+	size_t size = 4096;
+	while (size < ring_size)
+		size *= 2;
+	_ring.resize(size);
+	_mask = size - 1;
+}
+
+
+capture::~capture()
+{
+	close();
+}
+
+
+bool capture::open(const std::string& path)
+{
+	close();
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file)
+		return false;
+	_file.write(capture_magic, sizeof(capture_magic));
+	_head.store(0);
+	_tail.store(0);
+	_dropped.store(0);
+	_running = true;
+	_writer = std::thread(&capture::_write_loop, this);
+	return true;
+}
+
+
+void capture::close()
+{
+	if (_running == false)
+		return;
+	_running = false;
+	_writer.join();
+	_file.close();
+}
+
+
+void capture::record(direction dir, const void* data, size_t size)
+{
+	asio::const_buffer buffer(data, size);
+	record(dir, &buffer, 1);
+}
+
+
+void capture::record(direction dir, const asio::const_buffer* buffers, size_t count)
+{
+	if (_running == false)
+		return;
+	size_t size = 0;
+	for (size_t i = 0; i < count; i++)
+		size += buffers[i].size();
+	uint64_t head = _head.load(std::memory_order_relaxed);
+	uint64_t tail = _tail.load(std::memory_order_acquire);
+	if (_ring.size() - (head - tail) < record_header_size + size)
+	{
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	uint8_t header[record_header_size] = {0};
+	uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	store_le(header, timestamp, 8);
+	header[8] = (uint8_t)dir;
+	store_le(header + 12, size, 4);
+	_copy_in(head, header, record_header_size);
+	head += record_header_size;
+	for (size_t i = 0; i < count; i++)
+	{
+		_copy_in(head, buffers[i].data(), buffers[i].size());
+		head += buffers[i].size();
+	}
+	_head.store(head, std::memory_order_release);
+}
+
+
+void capture::_copy_in(uint64_t position, const void* data, size_t size)
+{
+	size_t offset = (size_t)(position & _mask);
+	size_t first = std::min(size, _ring.size() - offset);
+	memcpy(_ring.data() + offset, data, first);
+	memcpy(_ring.data(), (const uint8_t*)data + first, size - first);
+}
+
+
+bool capture::_write_pending()
+{
+	uint64_t tail = _tail.load(std::memory_order_relaxed);
+	uint64_t head = _head.load(std::memory_order_acquire);
+	if (head == tail)
+		return false;
+	size_t offset = (size_t)(tail & _mask);
+	size_t size = (size_t)(head - tail);
+	size_t first = std::min(size, _ring.size() - offset);
+	_file.write((const char*)_ring.data() + offset, first);
+	_file.write((const char*)_ring.data(), size - first);
+	_file.flush();
+	_tail.store(head, std::memory_order_release);
+	return true;
+}
+
+
+void capture::_write_loop()
+{
+	while (_running)
+	{
+		if (_write_pending() == false)
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	_write_pending();
+}
+
+
+bool capture_reader::open(const std::string& path)
+{
+	_file.open(path, std::ios::binary);
+	char magic[sizeof(capture_magic)];
+	if (!_file.read(magic, sizeof(magic)))
+		return false;
+	return memcmp(magic, capture_magic, sizeof(magic)) == 0;
+}
+
+
+bool capture_reader::next(capture_record& record)
+{
+	uint8_t header[record_header_size];
+	if (!_file.read((char*)header, record_header_size))
+		return false;
+	record.timestamp = load_le(header, 8);
+	record.dir = (capture::direction)header[8];
+	record.data.resize((size_t)load_le(header + 12, 4));
+	return record.data.empty() || (bool)_file.read((char*)record.data.data(), record.data.size());
+}
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <asio/buffer.hpp>
+
+namespace nwaasio {
+    /**
+     * @brief Record the network trafic of a client in a compact binary file
+     *
+     * The data is copied in a lock free ring buffer and written to the file by a background
+     * thread, so recording only cost a copy on the io thread. When the ring is full the record
+     * is dropped and counted in dropped().
+     *
+     * The file starts with the 8 bytes "NWACAP1\0", each record is a 16 bytes little endian
+     * header (timestamp in nanoseconds since epoch on 8 bytes, direction on 1 byte, 3 unused
+     * bytes, data size on 4 bytes) followed by the data. Use capture_reader to decode it.
+     */
+    class capture {
+    public:
+        enum class direction : uint8_t {
+            SENT,
+            RECEIVED,
+        };
+        /**
+         * @brief Create a capture
+         * @param ring_size The size of the ring buffer, rounded up to a power of two
+         */
+        explicit capture(size_t ring_size = 4 * 1024 * 1024);
+        ~capture();
+        capture(const capture&) = delete;
+        capture& operator=(const capture&) = delete;
+
+        /**
+         * @brief Create the file and start the writer thread
+         * @return false if the file can't be created
+         */
+        bool open(const std::string& path);
+        /**
+         * @brief Write what is left in the ring, stop the writer thread and close the file
+         */
+        void close();
+        bool is_open() const { return _running; }
+
+        /**
+         * @brief Record data, this must always be called from the same thread
+         */
+        void record(direction dir, const void* data, size_t size);
+        /**
+         * @brief Record the content of several buffers as a single record
+         */
+        void record(direction dir, const asio::const_buffer* buffers, size_t count);
+        /**
+         * @brief The number of records that did not fit in the ring
+         */
+        uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<uint8_t>	_ring;
+        size_t					_mask;
+        // Free running positions, the producer owns _head and the writer thread owns _tail
+        std::atomic<uint64_t>	_head{0};
+        std::atomic<uint64_t>	_tail{0};
+        std::atomic<uint64_t>	_dropped{0};
+        std::atomic<bool>		_running{false};
+        std::ofstream			_file;
+        std::thread				_writer;
+
+        void	_copy_in(uint64_t position, const void* data, size_t size);
+        void	_write_loop();
+        bool	_write_pending();
+    };
+
+    /**
+     * @brief A record read from a capture file
+     */
+    struct capture_record {
+        uint64_t			timestamp;
+        capture::direction	dir;
+        std::vector<uint8_t> data;
+    };
+
+    /**
+     * @brief Read the records of a file made by capture
+     */
+    class capture_reader {
+    public:
+        /**
+         * @brief Open a capture file
+         * @return false if the file can't be opened or is not a capture
+         */
+        bool open(const std::string& path);
+        /**
+         * @brief Read the next record
+         * @return false at the end of the file
+         */
+        bool next(capture_record& record);
+
+    private:
+        std::ifstream _file;
+    };
+}
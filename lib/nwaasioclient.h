@@ -2,20 +2,48 @@
 
 #include <cstdint>
 #include <stdint.h>
+#include <functional>
+#include <vector>
 #include "nwaasio.h"
+#include "nwaasiocapture.h"
+#include "nwaasiofunction.h"
+#include "nwaasiolog.h"
+#include "nwaasiomemory.h"
+#include "nwaasioparser.h"
+#include "nwaasioprepared.h"
 #include <asio/ip/tcp.hpp>
 #include <asio/io_service.hpp>
 
 using asio::ip::tcp;
 
 namespace nwaasio {
+    /**
+     * @brief The function called with a reply, it can take a const nwaasio::reply& or take
+     * the reply with a nwaasio::reply&& to keep it, and its data, without copying anything
+     */
+    using reply_callback = unique_function<void(nwaasio::reply&&)>;
     /**
      * @brief This is a client class for the Emulator Network Access protocol using asio 
      * 
      * This is an async client, you will need to set some callbacks to iteract with it
+     *
+     * Once its queues and buffers have grown, sending a command and dispatching its reply do not
+     * allocate as long as the callback fits in unique_function and the strings the client keeps a
+     * copy of fit in the small string buffer of std::string, 15 chars with libstdc++ and MSVC.
+     * These strings are the command name and, unless it is a prepared command, the arguments.
+     * A longer one is copied on the heap for each command, like EMULATION_STATUS.
      */
     class client {
     public:
+        /**
+         * @brief Counters about the write coalescing, see set_write_coalescing
+         */
+        struct write_stats {
+            uint64_t	flushes = 0;
+            uint64_t	commands = 0;
+            uint64_t	bytes = 0;
+            uint64_t	max_commands_per_flush = 0;
+        };
         /**
          * @brief Create a client
          * @param io_service The asio io service context
@@ -32,6 +60,16 @@ namespace nwaasio {
          * @param t 
          */
         void show_trafic(bool t);
+        /**
+         * @brief Set where the client sends its log messages, there is no logging by default
+         * @param sink the sink, it must outlive the client, nullptr to disable the logging
+         */
+        void set_log_sink(log_sink* sink);
+        /**
+         * @brief Record all the data sent and received in a capture, this is much cheaper than show_trafic
+         * @param c the capture, it must outlive the client, nullptr to stop recording
+         */
+        void set_capture(capture* c);
         /**
          * @brief Set the function to call when the client connect
          * @param callback the connect callback
@@ -44,15 +82,40 @@ namespace nwaasio {
         void set_connection_error_handler(std::function<void(const asio::error_code&)> callback);
         /**
          * @brief Set the function to call when the client lost the connection to the emulator
+         * The commands still waiting for a reply get an INVALID reply before it is called, and the
+         * commands submitted until the client connects again get one too
          * @param callback 
          */
         void set_disconnected_handler(std::function<void()> callback);
         /**
          * @brief Set the function to call when the emulator send a reply to a command
          * note that setting a callback when using a command method will override the call to this callback
-         * @param callback you received a const nwaasio::reply
+         * @param callback you received the nwaasio::reply
+         */
+        void set_reply_handler(reply_callback callback);
+        /**
+         * @brief Set how many commands can be sent to the emulator without waiting for their reply
+         * Commands above this limit are queued and sent when a reply comes back, replies are matched
+         * to the commands in the order they were sent. The default is 1 (no pipelining)
+         * @param depth the maximum number of commands in flight, at least 1
+         */
+        void set_pipeline_depth(size_t depth);
+        /**
+         * @brief Batch the commands sent during the same handler run into a single send
+         * The batch is flushed when the current handler returns or when it reaches threshold bytes.
+         * This is off by default, disabling it flushes what is pending.
+         * @param enabled true to enable the coalescing
+         * @param threshold the size in bytes that trigger a flush
+         */
+        void set_write_coalescing(bool enabled, size_t threshold = 16384);
+        /**
+         * @brief Get the counters of the write coalescing
+         */
+        const write_stats& coalescing_stats() const { return _write_stats; }
+        /**
+         * @brief Get the hit/miss counters of the pool used for the binary reply data
          */
-        void set_reply_handler(std::function<void(const nwaasio::reply&)> callback);
+        buffer_pool::stats payload_pool_stats() const { return _payload_pool.statistics(); }
         void raw_command(const std::string& raw);
         /**
          * @brief Execute a simple command without argument
@@ -60,7 +123,7 @@ namespace nwaasio {
          * @param callback An optionnal callback that will be called instead of the general one when the command
          * is done
          */
-        void command(const std::string& command, std::function<void(const nwaasio::reply&)> callback = nullptr);
+        void command(const std::string& command, reply_callback callback = nullptr);
         /**
          * @brief Execute a complete command
          * @param command The command
@@ -68,7 +131,7 @@ namespace nwaasio {
          * @param callback An optionnal callback that will be called instead of the general one when the command
          * is done
          */
-        void command(const std::string& command, const std::list<std::string>& args, std::function<void(const nwaasio::reply&)> callback = nullptr);
+        void command(const std::string& command, const std::list<std::string>& args, reply_callback callback = nullptr);
         /**
          * @brief Execute a command with a single argument
          * @param command The command
@@ -76,7 +139,61 @@ namespace nwaasio {
          * @param callback An optionnal callback that will be called instead of the general one when the command
          * is done
          */
-        void command(const std::string& command, const std::string& args, std::function<void(const nwaasio::reply&)> callback = nullptr);
+        void command(const std::string& command, const std::string& args, reply_callback callback = nullptr);
+        /**
+         * @brief Execute a command that reply with binary data, the data is written directly in destination
+         * If the size of the binary reply is not the size of destination, the destination is left untouched
+         * and the callback receives an invalid reply with the reason in error_reason.
+         * @param command The command
+         * @param args the argument, note that you can pass a nwa formated string of arguments
+         * @param destination Where to write the data, it must stay valid until the reply is received
+         * @param callback An optionnal callback that will be called instead of the general one when the command
+         * is done
+         */
+        void read_into(const std::string& command, const std::string& args, asio::mutable_buffer destination, reply_callback callback = nullptr);
+        /**
+         * @brief Execute a command that reply with binary data, the data is written directly in destination
+         * @param command The command
+         * @param args A list of arguments to pass to the command
+         * @param destination Where to write the data, it must stay valid until the reply is received
+         * @param callback An optionnal callback that will be called instead of the general one when the command
+         * is done
+         */
+        void read_into(const std::string& command, const std::list<std::string>& args, asio::mutable_buffer destination, reply_callback callback = nullptr);
+        /**
+         * @brief Execute a prepared command, its text is sent as it is without any formatting
+         * @param command The prepared command, it can be changed or destroyed right after this call
+         * @param callback An optionnal callback that will be called instead of the general one when the command
+         * is done
+         */
+        void command(const prepared_command& command, reply_callback callback = nullptr);
+        /**
+         * @brief Execute a prepared command that reply with binary data, the data is written directly in destination
+         * @param command The prepared command, it can be changed or destroyed right after this call
+         * @param destination Where to write the data, it must stay valid until the reply is received
+         * @param callback An optionnal callback that will be called instead of the general one when the command
+         * is done
+         */
+        void read_into(const prepared_command& command, asio::mutable_buffer destination, reply_callback callback = nullptr);
+        /**
+         * @brief Execute a command that takes a block of binary data, like bCORE_WRITE
+         * The command line, the header of the block and the data are sent together, the data is not copied.
+         * @param command The command
+         * @param args the argument, note that you can pass a nwa formated string of arguments
+         * @param data The data to send, it must stay valid until the reply is received
+         * @param callback An optionnal callback that will be called instead of the general one when the command
+         * is done
+         */
+        void binary_command(const std::string& command, const std::string& args, asio::const_buffer data, reply_callback callback = nullptr);
+        /**
+         * @brief Execute a command that takes a block of binary data, like bCORE_WRITE
+         * @param command The command
+         * @param args A list of arguments to pass to the command
+         * @param data The data to send, it must stay valid until the reply is received
+         * @param callback An optionnal callback that will be called instead of the general one when the command
+         * is done
+         */
+        void binary_command(const std::string& command, const std::list<std::string>& args, asio::const_buffer data, reply_callback callback = nullptr);
 
     private:
         enum class NWAState {
@@ -89,34 +206,96 @@ namespace nwaasio {
         std::string	_hostname;
         uint32_t	_port;
         bool		_show_trafic = false;
+        log_sink*	_log_sink = nullptr;
+        capture*	_capture = nullptr;
 
         asio::io_service& _io_service;
         tcp::socket _socket;
         char	_read_buffer[2048];
         nwaasio::reply						_current_reply;
-        std::string							_current_command;
+        buffer_pool							_payload_pool;
+
+        struct _pending_command {
+            _pending_command() = default;
+            _pending_command(std::string cmd, reply_callback cb, asio::mutable_buffer dest = asio::mutable_buffer())
+                : command(std::move(cmd)), callback(std::move(cb)), destination(dest) {}
+            std::string command;
+            reply_callback callback;
+            asio::mutable_buffer destination;
+        };
+        // Commands sent to the emulator, the front one is the next to get a reply
+        fifo<_pending_command>	_in_flight;
+        // What is sent for a command, the parts are sent as a single gathered write
+        struct _write_frame {
+            _write_frame() = default;
+            _write_frame(std::string cmd, std::string args) : command(std::move(cmd)), arguments(std::move(args)) {}
+            std::string command;
+            std::string arguments;
+            // command is already formatted data, like a batch of coalesced commands
+            bool raw = false;
+            // The text of a prepared command, sent instead of command and arguments
+            std::shared_ptr<const std::string> prepared;
+            // The binary block sent after the command line, from the caller memory
+            bool binary = false;
+            uint8_t binary_header[5] = {};
+            asio::const_buffer binary_data;
+        };
+        // Commands waiting for a free slot in the pipeline, with their data to send
+        fifo<std::pair<_pending_command, _write_frame> > _queued;
+        size_t	_pipeline_depth = 1;
+
+        fifo<_write_frame>					_write_queue;
+        // The frame being written, out of the queue so it does not move while asio uses it
+        _write_frame						_current_write;
+        std::vector<asio::const_buffer>		_write_buffers;
+        bool								_writing = false;
+
+        bool		_coalescing = false;
+        size_t		_coalescing_threshold = 16384;
+        bool		_coalescing_flush_posted = false;
+        std::string	_coalescing_buffer;
+        // A second buffer so a batch can be filled while the previous one is written
+        std::string	_coalescing_spare;
+        uint64_t	_coalescing_count = 0;
+        write_stats	_write_stats;
+
+        // The memory of the asio handlers, there is at most one operation of each kind at a time
+        handler_memory	_connect_handler_memory;
+        handler_memory	_read_handler_memory;
+        handler_memory	_write_handler_memory;
+        handler_memory	_post_handler_memory;
 
         std::function<void()> _disconnected_callback = nullptr;
         std::function<void()> _connected_callback = nullptr;
         std::function<void(const asio::error_code&)> _connection_error_callback = nullptr;
-        std::function<void(const nwaasio::reply&)> _current_reply_callback = nullptr;
-        std::function<void(const nwaasio::reply&)> _general_reply_callback = nullptr;
+        reply_callback _general_reply_callback = nullptr;
 
         // Used for parsing reply
         uint32_t _binary_reply_offset = 0;
-        uint8_t _binary_header_size;
-        std::string _ascii_buffer;
+        uint8_t _binary_header_size = 0;
+        bool _binary_size_mismatch = false;
+        ascii_parser _ascii_parser;
 
         void _set_async_read();
         void _attempt_connect(tcp::resolver::iterator endpoint_iter);
         void _handle_connect(const asio::error_code& error, tcp::resolver::results_type::iterator endpoint_iter);
         void _read_data(const asio::error_code& error, std::size_t bytes_transferred);
-        void _ascii_reply_done();
+        void _read_binary_payload(const asio::error_code& error, std::size_t bytes_transferred);
+        bool _parse_read_buffer(std::size_t bytes_transferred);
+        void _binary_reply_done();
+        bool _ascii_reply_done();
         void _send_reply();
         void _disconnected();
+        void _fail_command(_pending_command&& pending, const char* reason);
         void _invalid_reply();
         void _reinit_reply();
-        void _write_socket(const std::string& tosend);
+        void _submit(_pending_command&& pending, _write_frame&& tosend);
+        void _send_queued();
+        static std::string _join_arguments(const std::list<std::string>& args);
+        void _write_socket(_write_frame&& tosend);
+        void _start_write();
+        void _flush_coalesced();
+        void _handle_write(const asio::error_code& error);
     };
 }
 
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstring>
+#include "nwaasiodiff.h"
+#include "nwaasiosimd.h"
+
+namespace nwaasio {
+
+// The offset of the first byte from offset that differs, or that is equal, size if there is none
+using find_function = size_t (*)(const uint8_t* before, const uint8_t* after, size_t offset, size_t size);
+
+struct diff_functions {
+	diff_kernel		kernel;
+	find_function	find_difference;
+	find_function	find_equal;
+};
+
+
+static size_t scalar_find_difference(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	for (; size - offset >= 8; offset += 8)
+	{
+		uint64_t a, b;
+		memcpy(&a, before + offset, 8);
+		memcpy(&b, after + offset, 8);
+		if (a != b)
+			break;
+	}
+	while (offset < size && before[offset] == after[offset])
+		offset++;
+	return offset;
+}
+
+
+static size_t scalar_find_equal(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	while (offset < size && before[offset] != after[offset])
+		offset++;
+	return offset;
+}
+
+
+#if defined(NWAASIO_USE_SSE2)
+static size_t sse2_find_difference(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	for (; size - offset >= 16; offset += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(before + offset));
+		__m128i b = _mm_loadu_si128((const __m128i*)(after + offset));
+		uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+		if (equal != 0xFFFF)
+			return offset + count_trailing_zeros(~equal);
+	}
+	return scalar_find_difference(before, after, offset, size);
+}
+
+
+static size_t sse2_find_equal(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	for (; size - offset >= 16; offset += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(before + offset));
+		__m128i b = _mm_loadu_si128((const __m128i*)(after + offset));
+		uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+		if (equal != 0)
+			return offset + count_trailing_zeros(equal);
+	}
+	return scalar_find_equal(before, after, offset, size);
+}
+#endif
+
+
+#if defined(NWAASIO_BUILD_AVX2)
+NWAASIO_AVX2_FUNCTION static size_t avx2_find_difference(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	// Most of the memory does not change, check 64 bytes at a time before looking for the byte
+	for (; size - offset >= 64; offset += 64)
+	{
+		__m256i a0 = _mm256_loadu_si256((const __m256i*)(before + offset));
+		__m256i b0 = _mm256_loadu_si256((const __m256i*)(after + offset));
+		__m256i a1 = _mm256_loadu_si256((const __m256i*)(before + offset + 32));
+		__m256i b1 = _mm256_loadu_si256((const __m256i*)(after + offset + 32));
+		__m256i changes = _mm256_or_si256(_mm256_xor_si256(a0, b0), _mm256_xor_si256(a1, b1));
+		if (_mm256_testz_si256(changes, changes) == 0)
+			break;
+	}
+	for (; size - offset >= 32; offset += 32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(before + offset));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(after + offset));
+		uint32_t equal = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+		if (equal != 0xFFFFFFFF)
+			return offset + count_trailing_zeros(~equal);
+	}
+	return scalar_find_difference(before, after, offset, size);
+}
+
+
+NWAASIO_AVX2_FUNCTION static size_t avx2_find_equal(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	for (; size - offset >= 32; offset += 32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(before + offset));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(after + offset));
+		uint32_t equal = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+		if (equal != 0)
+			return offset + count_trailing_zeros(equal);
+	}
+	return scalar_find_equal(before, after, offset, size);
+}
+#endif
+
+
+static const diff_functions scalar_functions = {diff_kernel::SCALAR, scalar_find_difference, scalar_find_equal};
+#if defined(NWAASIO_USE_SSE2)
+static const diff_functions sse2_functions = {diff_kernel::SSE2, sse2_find_difference, sse2_find_equal};
+#endif
+#if defined(NWAASIO_BUILD_AVX2)
+static const diff_functions avx2_functions = {diff_kernel::AVX2, avx2_find_difference, avx2_find_equal};
+#endif
+
+
+static const diff_functions* best_functions(diff_kernel wanted)
+{
+#if defined(NWAASIO_BUILD_AVX2)
+	static const bool has_avx2 = cpu_has_avx2();
+	if (wanted == diff_kernel::AVX2 && has_avx2)
+		return &avx2_functions;
+#endif
+#if defined(NWAASIO_USE_SSE2)
+	if (wanted != diff_kernel::SCALAR)
+		return &sse2_functions;
+#endif
+	return &scalar_functions;
+}
+
+
+static const diff_functions*& active_functions()
+{
+	static const diff_functions* functions = best_functions(diff_kernel::AVX2);
+	return functions;
+}
+
+
+diff_kernel active_diff_kernel()
+{
+	return active_functions()->kernel;
+}
+
+
+diff_kernel set_diff_kernel(diff_kernel kernel)
+{
+	active_functions() = best_functions(kernel);
+	return active_functions()->kernel;
+}
+
+
+size_t find_difference(const uint8_t* before, const uint8_t* after, size_t offset, size_t size)
+{
+	return active_functions()->find_difference(before, after, std::min(offset, size), size);
+}
+
+
+size_t diff_runs(const uint8_t* before, const uint8_t* after, size_t size, std::vector<diff_run>& runs, size_t merge_gap)
+{
+	const diff_functions& functions = *active_functions();
+	size_t changed = 0;
+	size_t offset = 0;
+	runs.clear();
+	while (true)
+	{
+		offset = functions.find_difference(before, after, offset, size);
+		if (offset == size)
+			break;
+		size_t end = functions.find_equal(before, after, offset, size);
+		changed += end - offset;
+		if (runs.empty() == false && offset - (runs.back().offset + runs.back().length) <= merge_gap)
+			runs.back().length = (uint32_t) (end - runs.back().offset);
+		else
+			runs.push_back(diff_run{(uint32_t) offset, (uint32_t) (end - offset)});
+		offset = end;
+	}
+	return changed;
+}
+
+
+size_t diff_blocks(const uint8_t* before, const uint8_t* after, size_t size, size_t block_size, std::vector<uint64_t>& bitmap)
+{
+	const diff_functions& functions = *active_functions();
+	block_size = std::max(block_size, (size_t) 1);
+	size_t block_count = (size + block_size - 1) / block_size;
+	bitmap.assign((block_count + 63) / 64, 0);
+	size_t dirty = 0;
+	size_t offset = 0;
+	while (offset < size)
+	{
+		offset = functions.find_difference(before, after, offset, size);
+		if (offset == size)
+			break;
+		size_t block = offset / block_size;
+		bitmap[block / 64] |= (uint64_t) 1 << (block % 64);
+		dirty++;
+		// The rest of the block does not matter anymore
+		offset = (block + 1) * block_size;
+	}
+	return dirty;
+}
+
+}
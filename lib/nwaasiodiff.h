@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nwaasio {
+    /**
+     * @brief A run of bytes that differ between two snapshots, from offset to offset + length
+     */
+    struct diff_run {
+        uint32_t	offset;
+        uint32_t	length;
+    };
+    /**
+     * @brief The implementations of the diff functions, the best one the cpu supports is picked at runtime
+     */
+    enum class diff_kernel {
+        SCALAR,
+        SSE2,
+        AVX2,
+    };
+    /**
+     * @brief The implementation used by the diff functions
+     */
+    diff_kernel	active_diff_kernel();
+    /**
+     * @brief Use another implementation, to compare them, it falls back to the best available one
+     * if the cpu does not support it
+     * @return the implementation now used
+     */
+    diff_kernel	set_diff_kernel(diff_kernel kernel);
+
+    /**
+     * @brief Find the runs of bytes that differ between two snapshots of the same size
+     * @param runs Receives the runs sorted by offset, it is cleared first
+     * @param merge_gap Two runs separated by at most merge_gap equal bytes are reported as one run
+     * @return the number of different bytes, without the merged gaps
+     */
+    size_t	diff_runs(const uint8_t* before, const uint8_t* after, size_t size, std::vector<diff_run>& runs, size_t merge_gap = 0);
+    /**
+     * @brief Mark the blocks that differ between two snapshots of the same size
+     * @param block_size The size of a block, the last block can be smaller
+     * @param bitmap Receives one bit per block, bit i % 64 of word i / 64 is set if block i differs
+     * @return the number of blocks that differ
+     */
+    size_t	diff_blocks(const uint8_t* before, const uint8_t* after, size_t size, size_t block_size, std::vector<uint64_t>& bitmap);
+    /**
+     * @brief The offset of the first byte that differs from offset, size if there is none
+     */
+    size_t	find_difference(const uint8_t* before, const uint8_t* after, size_t offset, size_t size);
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace nwaasio {
+    template <typename Signature>
+    class unique_function;
+
+    /**
+     * @brief A move only replacement of std::function that stores small callables inline
+     *
+     * Callables up to inline_size bytes that can be moved without throwing never allocate,
+     * this is the case of lambdas capturing a few pointers or a std::function.
+     */
+    template <typename R, typename... Args>
+    class unique_function<R(Args...)> {
+    public:
+        static constexpr size_t inline_size = 6 * sizeof(void*);
+
+        unique_function() noexcept = default;
+        unique_function(std::nullptr_t) noexcept {}
+        template <typename F, typename = std::enable_if_t<
+            !std::is_same<std::decay_t<F>, unique_function>::value
+            && std::is_invocable_r<R, std::decay_t<F>&, Args...>::value> >
+        unique_function(F&& f)
+        {
+            using callable = std::decay_t<F>;
+            if (_is_empty(f))
+                return;
+            if constexpr (_fits_inline<callable>())
+            {
+                new (&_storage) callable(std::forward<F>(f));
+                _ops = &_inline_ops<callable>;
+            }
+            else {
+                *reinterpret_cast<callable**>(&_storage) = new callable(std::forward<F>(f));
+                _ops = &_heap_ops<callable>;
+            }
+        }
+        unique_function(unique_function&& other) noexcept
+        {
+            _take(other);
+        }
+        unique_function& operator=(unique_function&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                _take(other);
+            }
+            return *this;
+        }
+        unique_function& operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+        unique_function(const unique_function&) = delete;
+        unique_function& operator=(const unique_function&) = delete;
+        ~unique_function() { reset(); }
+
+        R operator()(Args... args) const
+        {
+            return _ops->invoke(const_cast<void*>(static_cast<const void*>(&_storage)), std::forward<Args>(args)...);
+        }
+        explicit operator bool() const noexcept { return _ops != nullptr; }
+        bool operator==(std::nullptr_t) const noexcept { return _ops == nullptr; }
+        bool operator!=(std::nullptr_t) const noexcept { return _ops != nullptr; }
+        void reset() noexcept
+        {
+            if (_ops != nullptr)
+                _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+
+    private:
+        struct ops {
+            R		(*invoke)(void* storage, Args&&... args);
+            // Move the callable from storage to an empty destination, and destroy the source
+            void	(*move)(void* destination, void* storage) noexcept;
+            void	(*destroy)(void* storage) noexcept;
+        };
+
+        template <typename F>
+        static bool _is_empty(const F& f)
+        {
+            if constexpr (std::is_pointer<F>::value || std::is_member_pointer<F>::value)
+                return f == nullptr;
+            else
+                return false;
+        }
+        template <typename S>
+        static bool _is_empty(const std::function<S>& f) { return !f; }
+
+        template <typename F>
+        static constexpr bool _fits_inline()
+        {
+            return sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible<F>::value;
+        }
+
+        template <typename F>
+        static constexpr ops _inline_ops = {
+            [](void* storage, Args&&... args) -> R {
+                return (*static_cast<F*>(storage))(std::forward<Args>(args)...);
+            },
+            [](void* destination, void* storage) noexcept {
+                new (destination) F(std::move(*static_cast<F*>(storage)));
+                static_cast<F*>(storage)->~F();
+            },
+            [](void* storage) noexcept {
+                static_cast<F*>(storage)->~F();
+            },
+        };
+
+        template <typename F>
+        static constexpr ops _heap_ops = {
+            [](void* storage, Args&&... args) -> R {
+                return (**static_cast<F**>(storage))(std::forward<Args>(args)...);
+            },
+            [](void* destination, void* storage) noexcept {
+                *static_cast<F**>(destination) = *static_cast<F**>(storage);
+            },
+            [](void* storage) noexcept {
+                delete *static_cast<F**>(storage);
+            },
+        };
+
+        void _take(unique_function& other) noexcept
+        {
+            if (other._ops != nullptr)
+                other._ops->move(&_storage, &other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+
+        std::aligned_storage_t<inline_size, alignof(std::max_align_t)>	_storage;
+        const ops*	_ops = nullptr;
+    };
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstring>
+#include "nwaasiohistory.h"
+
+namespace nwaasio {
+
+// Equal bytes between two changed runs cost less inside a run than as a new run header
+static const size_t run_merge_gap = 4;
+
+
+static void write_varint(std::vector<uint8_t>& out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t) (value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t) value);
+}
+
+
+static size_t read_varint(const uint8_t*& p)
+{
+	size_t value = 0;
+	unsigned int shift = 0;
+	while (*p & 0x80)
+	{
+		value |= (size_t) (*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	value |= (size_t) *p++ << shift;
+	return value;
+}
+
+
+snapshot_history::snapshot_history(size_t snapshot_size, size_t memory_budget, size_t keyframe_interval)
+	: _size(snapshot_size), _memory_budget(memory_budget), _keyframe_interval(std::max(keyframe_interval, (size_t) 1)),
+	_latest(snapshot_size), _zeros(snapshot_size), _cache(snapshot_size)
+{
+}
+
+
+void snapshot_history::clear()
+{
+	_entries.clear();
+	_first = 0;
+	_since_keyframe = 0;
+	_cache_sequence = UINT64_MAX;
+	_stats = stats();
+}
+
+
+// A run is the distance from the end of the previous run, its size, then its bytes XORed
+void snapshot_history::_encode(const uint8_t* before, const uint8_t* after, std::vector<uint8_t>& out)
+{
+	diff_runs(before, after, _size, _runs, run_merge_gap);
+	_scratch.clear();
+	size_t position = 0;
+	for (const diff_run& run : _runs)
+	{
+		write_varint(_scratch, run.offset - position);
+		write_varint(_scratch, run.length);
+		for (size_t i = run.offset; i < run.offset + run.length; i++)
+			_scratch.push_back(before[i] ^ after[i]);
+		position = run.offset + run.length;
+	}
+	out.assign(_scratch.begin(), _scratch.end());
+}
+
+
+void snapshot_history::_apply(const std::vector<uint8_t>& encoded, uint8_t* data)
+{
+	const uint8_t* p = encoded.data();
+	const uint8_t* end = p + encoded.size();
+	uint8_t* position = data;
+	while (p < end)
+	{
+		position += read_varint(p);
+		size_t length = read_varint(p);
+		for (size_t i = 0; i < length; i++)
+			position[i] ^= p[i];
+		p += length;
+		position += length;
+	}
+}
+
+
+uint64_t snapshot_history::push(const uint8_t* data)
+{
+	bool keyframe = _entries.empty() || _since_keyframe + 1 >= _keyframe_interval;
+	_entries.push_back(_entry{keyframe, {}});
+	_entry& entry = _entries.back();
+	_encode(keyframe ? _zeros.data() : _latest.data(), data, entry.data);
+	memcpy(_latest.data(), data, _size);
+	_since_keyframe = keyframe ? 0 : _since_keyframe + 1;
+
+	_stats.snapshots++;
+	_stats.memory_bytes += entry.data.size();
+	if (keyframe)
+		_stats.keyframes++;
+	while (_stats.memory_bytes > _memory_budget && _entries.size() > 1)
+		_drop_oldest();
+	return last();
+}
+
+
+void snapshot_history::_drop_oldest()
+{
+	// The next snapshot becomes the keyframe the ones after it are rebuilt from
+	if (_entries[1].keyframe == false)
+	{
+		_entry& next = _entries[1];
+		std::vector<uint8_t>& state = _scratch_state;
+		state.assign(_size, 0);
+		_apply(_entries[0].data, state.data());
+		_apply(next.data, state.data());
+		_stats.memory_bytes -= next.data.size();
+		_encode(_zeros.data(), state.data(), next.data);
+		_stats.memory_bytes += next.data.size();
+		next.keyframe = true;
+		_stats.keyframes++;
+	}
+	_stats.memory_bytes -= _entries.front().data.size();
+	_stats.keyframes--;
+	_stats.snapshots--;
+	_stats.dropped++;
+	_entries.pop_front();
+	_first++;
+}
+
+
+size_t snapshot_history::snapshot_bytes(uint64_t sequence) const
+{
+	if (_entries.empty() || sequence < _first || sequence > last())
+		return 0;
+	return _entries[sequence - _first].data.size();
+}
+
+
+bool snapshot_history::get(uint64_t sequence, uint8_t* out)
+{
+	if (_entries.empty() || sequence < _first || sequence > last())
+		return false;
+	size_t index = sequence - _first;
+	size_t keyframe = index;
+	while (_entries[keyframe].keyframe == false)
+		keyframe--;
+
+	// The newest snapshot and the cached one are other starting points, if they are after the keyframe
+	// and no keyframe is between them and the wanted snapshot
+	auto usable = [&](size_t start) {
+		if (start < keyframe)
+			return false;
+		for (size_t i = index + 1; i <= start; i++)
+		{
+			if (_entries[i].keyframe)
+				return false;
+		}
+		return true;
+	};
+	auto distance = [&](size_t start) { return start > index ? start - index : index - start; };
+	size_t best_distance = index - keyframe + 1;
+	const uint8_t* start_data = nullptr;
+	size_t start = keyframe;
+	size_t last_index = _entries.size() - 1;
+	if (usable(last_index) && distance(last_index) < best_distance)
+	{
+		best_distance = distance(last_index);
+		start_data = _latest.data();
+		start = last_index;
+	}
+	if (_cache_sequence >= _first && _cache_sequence <= last())
+	{
+		size_t cache_index = _cache_sequence - _first;
+		if (usable(cache_index) && distance(cache_index) < best_distance)
+		{
+			start_data = _cache.data();
+			start = cache_index;
+		}
+	}
+
+	if (start_data == nullptr)
+	{
+		memset(out, 0, _size);
+		_apply(_entries[keyframe].data, out);
+	}
+	else if (start_data != out)
+	{
+		memcpy(out, start_data, _size);
+	}
+	// A delta turns the previous snapshot into its own and its own into the previous one
+	for (size_t i = start + 1; i <= index; i++)
+		_apply(_entries[i].data, out);
+	for (size_t i = start; i > index; i--)
+		_apply(_entries[i].data, out);
+
+	memcpy(_cache.data(), out, _size);
+	_cache_sequence = sequence;
+	return true;
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "nwaasiodiff.h"
+
+namespace nwaasio {
+    /**
+     * @brief Keeps the successive snapshots of a memory range in a bounded amount of memory
+     *
+     * Every keyframe_interval snapshots a keyframe holds a whole snapshot, the snapshots between
+     * hold the bytes that changed since the previous one, XORed with their previous value. Both are
+     * stored as runs of non zero bytes so unchanged memory and zeroed areas cost a few bytes.
+     * A snapshot is rebuilt from the closest keyframe, or from the last snapshot rebuilt since an
+     * XOR delta works in both directions. When the memory used goes over the budget the oldest
+     * snapshots are dropped.
+     */
+    class snapshot_history {
+    public:
+        struct stats {
+            uint64_t	snapshots = 0;
+            uint64_t	keyframes = 0;
+            // The memory of the stored snapshots, without the fixed cost of the history
+            uint64_t	memory_bytes = 0;
+            uint64_t	dropped = 0;
+            /**
+             * @brief The average memory of a snapshot
+             */
+            double		bytes_per_snapshot() const { return snapshots == 0 ? 0.0 : (double) memory_bytes / snapshots; }
+        };
+
+        /**
+         * @brief Create an empty history
+         * @param snapshot_size The size of every snapshot
+         * @param memory_budget The memory the stored snapshots can use
+         * @param keyframe_interval How many snapshots there are from a keyframe to the next
+         */
+        snapshot_history(size_t snapshot_size, size_t memory_budget, size_t keyframe_interval = 64);
+
+        /**
+         * @brief Add a snapshot
+         * @param data snapshot_size bytes
+         * @return the sequence number of the snapshot, they start at 0 and are never reused
+         */
+        uint64_t	push(const uint8_t* data);
+        /**
+         * @brief Rebuild a snapshot
+         * @param sequence The sequence number returned by push
+         * @param out Receives snapshot_size bytes
+         * @return false if the snapshot is not in the history anymore
+         */
+        bool		get(uint64_t sequence, uint8_t* out);
+        /**
+         * @brief The memory used by a snapshot, 0 if it is not in the history
+         */
+        size_t		snapshot_bytes(uint64_t sequence) const;
+        bool		empty() const { return _entries.empty(); }
+        // The sequence numbers of the oldest and of the newest snapshot
+        uint64_t	first() const { return _first; }
+        uint64_t	last() const { return _first + _entries.size() - 1; }
+        size_t		count() const { return _entries.size(); }
+        size_t		snapshot_size() const { return _size; }
+        /**
+         * @brief The newest snapshot, without rebuilding it
+         */
+        const uint8_t*	latest() const { return _entries.empty() ? nullptr : _latest.data(); }
+        const stats&	statistics() const { return _stats; }
+        void		clear();
+
+    private:
+        struct _entry {
+            bool					keyframe;
+            std::vector<uint8_t>	data;
+        };
+        size_t				_size;
+        size_t				_memory_budget;
+        size_t				_keyframe_interval;
+        size_t				_since_keyframe = 0;
+        std::deque<_entry>	_entries;
+        uint64_t			_first = 0;
+        std::vector<uint8_t>	_latest;
+        std::vector<uint8_t>	_zeros;
+        // The last snapshot rebuilt by get
+        std::vector<uint8_t>	_cache;
+        uint64_t			_cache_sequence = UINT64_MAX;
+        std::vector<diff_run>	_runs;
+        std::vector<uint8_t>	_scratch;
+        std::vector<uint8_t>	_scratch_state;
+        stats				_stats;
+
+        void	_encode(const uint8_t* before, const uint8_t* after, std::vector<uint8_t>& out);
+        static void	_apply(const std::vector<uint8_t>& encoded, uint8_t* data);
+        void	_drop_oldest();
+    };
+}
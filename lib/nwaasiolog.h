@@ -0,0 +1,74 @@
+#pragma once
+#include <ostream>
+#include <string_view>
+
+namespace nwaasio {
+    enum class log_level {
+        LTRACE,
+        LDEBUG,
+        LINFO,
+        LWARNING,
+        LERROR,
+    };
+    /**
+     * @brief The name of a log level, like "warning"
+     */
+    inline const char* log_level_name(log_level level)
+    {
+        switch (level)
+        {
+        case log_level::LTRACE:
+            return "trace";
+        case log_level::LDEBUG:
+            return "debug";
+        case log_level::LINFO:
+            return "info";
+        case log_level::LWARNING:
+            return "warning";
+        case log_level::LERROR:
+            return "error";
+        }
+        return "unknown";
+    }
+    /**
+     * @brief Where the library sends its log messages, implement log() to receive them
+     *
+     * Messages below min_level are not even formatted. Define NWAASIO_DISABLE_LOGGING
+     * to remove all the logging code from the library.
+     */
+    class log_sink {
+    public:
+        explicit log_sink(log_level min_level = log_level::LINFO) : min_level(min_level) {}
+        virtual ~log_sink() = default;
+        virtual void log(log_level level, std::string_view message) = 0;
+        bool enabled(log_level level) const { return level >= min_level; }
+
+        log_level min_level;
+    };
+    /**
+     * @brief A log sink writing each message on a line of a std::ostream, without flushing it
+     * The line starts with the level, like "warning: Invalid reply to CORE_READ"
+     */
+    class stream_log_sink : public log_sink {
+    public:
+        explicit stream_log_sink(std::ostream& stream, log_level min_level = log_level::LINFO)
+            : log_sink(min_level), _stream(stream) {}
+        void log(log_level level, std::string_view message) override
+        {
+            _stream << log_level_name(level) << ": " << message << '\n';
+        }
+    private:
+        std::ostream& _stream;
+    };
+}
+
+// The message is only evaluated when the sink accepts the level
+#ifdef NWAASIO_DISABLE_LOGGING
+// Nothing is evaluated, sizeof only keeps the variables used
+#define NWAASIO_LOG(sink, level, message) do { (void)sizeof(sink); (void)sizeof(message); } while (0)
+#else
+#define NWAASIO_LOG(sink, level, message) do { \
+        if ((sink) != nullptr && (sink)->enabled(level)) \
+            (sink)->log(level, message); \
+    } while (0)
+#endif
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nwaasio {
+    /**
+     * @brief A memory block reused for the handler of an asynchronous operation
+     *
+     * There must be only one operation at a time using a handler_memory, when the block is
+     * in use or too small the memory comes from the heap.
+     */
+    class handler_memory {
+    public:
+        handler_memory() = default;
+        handler_memory(const handler_memory&) = delete;
+        handler_memory& operator=(const handler_memory&) = delete;
+
+        void* allocate(std::size_t size)
+        {
+            if (!_in_use && size <= sizeof(_storage))
+            {
+                _in_use = true;
+                return &_storage;
+            }
+            return ::operator new(size);
+        }
+        void deallocate(void* pointer)
+        {
+            if (pointer == &_storage)
+                _in_use = false;
+            else
+                ::operator delete(pointer);
+        }
+
+    private:
+        std::aligned_storage_t<1024, alignof(std::max_align_t)>	_storage;
+        bool	_in_use = false;
+    };
+
+    /**
+     * @brief An allocator using a handler_memory, to use with asio::bind_allocator
+     */
+    template <typename T>
+    class handler_allocator {
+    public:
+        using value_type = T;
+
+        explicit handler_allocator(handler_memory& memory) : _memory(&memory) {}
+        template <typename U>
+        handler_allocator(const handler_allocator<U>& other) noexcept : _memory(other._memory) {}
+
+        T* allocate(std::size_t n) { return static_cast<T*>(_memory->allocate(sizeof(T) * n)); }
+        void deallocate(T* pointer, std::size_t) { _memory->deallocate(pointer); }
+
+        bool operator==(const handler_allocator& other) const noexcept { return _memory == other._memory; }
+        bool operator!=(const handler_allocator& other) const noexcept { return _memory != other._memory; }
+
+    private:
+        template <typename> friend class handler_allocator;
+        handler_memory* _memory;
+    };
+
+    /**
+     * @brief A first in first out queue in a ring buffer, unlike std::deque it does not
+     * allocate when elements go through it once its capacity is large enough
+     */
+    template <typename T>
+    class fifo {
+    public:
+        bool		empty() const { return _size == 0; }
+        std::size_t	size() const { return _size; }
+        T&			front() { return _items[_head]; }
+        T&			back() { return _items[(_head + _size - 1) % _items.size()]; }
+
+        template <typename... Args>
+        T& emplace_back(Args&&... args)
+        {
+            if (_size == _items.size())
+                _grow();
+            T& item = _items[(_head + _size) % _items.size()];
+            item = T{std::forward<Args>(args)...};
+            _size++;
+            return item;
+        }
+        void push_back(T&& item) { emplace_back(std::move(item)); }
+        void pop_front()
+        {
+            _items[_head] = T();
+            _head = (_head + 1) % _items.size();
+            _size--;
+        }
+        /**
+         * @brief Remove the elements after the first count ones
+         */
+        void truncate(std::size_t count)
+        {
+            while (_size > count)
+            {
+                back() = T();
+                _size--;
+            }
+        }
+        void clear() { truncate(0); }
+
+    private:
+        std::vector<T>	_items;
+        std::size_t		_head = 0;
+        std::size_t		_size = 0;
+
+        void _grow()
+        {
+            std::vector<T> items(_items.empty() ? 8 : _items.size() * 2);
+            for (std::size_t i = 0; i < _size; i++)
+                items[i] = std::move(_items[(_head + i) % _items.size()]);
+            _items.swap(items);
+            _head = 0;
+        }
+    };
+
+    /**
+     * @brief A view on an array of buffers, asio copies the buffer sequence given to
+     * async_write so this avoids copying a std::vector on each write
+     */
+    template <typename Buffer>
+    class buffer_sequence_view {
+    public:
+        using value_type = Buffer;
+        using const_iterator = const Buffer*;
+
+        buffer_sequence_view(const Buffer* buffers, std::size_t count) : _begin(buffers), _end(buffers + count) {}
+
+        const_iterator	begin() const { return _begin; }
+        const_iterator	end() const { return _end; }
+
+    private:
+        const Buffer*	_begin;
+        const Buffer*	_end;
+    };
+}
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <asio/post.hpp>
+#include "nwaasiomirror.h"
+
+namespace nwaasio {
+
+memory_mirror::memory_mirror(asio::io_service& io_service, client& c, size_t block_size)
+	: _io_service(io_service), _client(c), _block_shift(0)
+{
+	while (((size_t) 1 << (_block_shift + 1)) <= block_size)
+		_block_shift++;
+}
+
+
+memory_mirror::~memory_mirror()
+{
+	*_alive = false;
+}
+
+
+void memory_mirror::init(done_callback done)
+{
+	_client.command("CORE_MEMORIES", [this, alive = _alive, done = std::move(done)](const reply& r) mutable {
+		if (*alive == false)
+			return;
+		if (r.is_ascii() == false)
+		{
+			if (done != nullptr)
+				done(false);
+			return;
+		}
+		for (const auto& record : r.records())
+		{
+			auto name = record.get("name");
+			auto size = record.get("size");
+			if (!name || !size)
+				continue;
+			size_t value = 0;
+			// The size is a decimal number but accept the $ hexadecimal notation of the arguments
+			if (size->size() > 1 && size->front() == '$')
+				std::from_chars(size->data() + 1, size->data() + size->size(), value, 16);
+			else
+				std::from_chars(size->data(), size->data() + size->size(), value);
+			add_domain(std::string(*name), value);
+		}
+		if (done != nullptr)
+			done(true);
+	});
+}
+
+
+void memory_mirror::add_domain(const std::string& name, size_t size)
+{
+	_domain* d = _find(name);
+	if (d == nullptr)
+	{
+		_domains.push_back(_domain{name, {}, {}, {}});
+		d = &_domains.back();
+	}
+	d->memory.assign(size, 0);
+	d->read_times.assign((size + ((size_t) 1 << _block_shift) - 1) >> _block_shift, clock::time_point());
+	d->fetching.assign(d->read_times.size(), 0);
+}
+
+
+size_t memory_mirror::domain_size(const std::string& name) const
+{
+	const _domain* d = _find(name);
+	return d == nullptr ? 0 : d->memory.size();
+}
+
+
+const uint8_t* memory_mirror::data(const std::string& name) const
+{
+	const _domain* d = _find(name);
+	return d == nullptr ? nullptr : d->memory.data();
+}
+
+
+const memory_mirror::_domain* memory_mirror::_find(const std::string& name) const
+{
+	for (const _domain& d : _domains)
+	{
+		if (d.name == name)
+			return &d;
+	}
+	return nullptr;
+}
+
+
+memory_mirror::_domain* memory_mirror::_find(const std::string& name)
+{
+	return const_cast<_domain*>(static_cast<const memory_mirror*>(this)->_find(name));
+}
+
+
+bool memory_mirror::_blocks(const _domain& d, uint32_t address, uint32_t size, size_t& first, size_t& last) const
+{
+	if ((uint64_t) address + size > d.memory.size() || size == 0)
+		return false;
+	first = address >> _block_shift;
+	last = (((uint64_t) address + size - 1) >> _block_shift) + 1;
+	return true;
+}
+
+
+memory_mirror::clock::time_point memory_mirror::read_time(const std::string& domain, uint32_t address, uint32_t size) const
+{
+	const _domain* d = _find(domain);
+	size_t first, last;
+	if (d == nullptr || _blocks(*d, address, size, first, last) == false)
+		return clock::time_point();
+	return *std::min_element(d->read_times.begin() + first, d->read_times.begin() + last);
+}
+
+
+bool memory_mirror::fresh(const std::string& domain, uint32_t address, uint32_t size, clock::duration max_age) const
+{
+	clock::time_point oldest = read_time(domain, address, size);
+	return oldest != clock::time_point() && clock::now() - oldest <= max_age;
+}
+
+
+void memory_mirror::invalidate(const std::string& domain, uint32_t address, uint32_t size)
+{
+	_domain* d = _find(domain);
+	size_t first, last;
+	if (d == nullptr || _blocks(*d, address, size, first, last) == false)
+		return;
+	std::fill(d->read_times.begin() + first, d->read_times.begin() + last, clock::time_point());
+}
+
+
+void memory_mirror::invalidate()
+{
+	for (_domain& d : _domains)
+		std::fill(d.read_times.begin(), d.read_times.end(), clock::time_point());
+	_reset_fetches();
+}
+
+
+void memory_mirror::_reset_fetches()
+{
+	_fetch_generation++;
+	_queued.clear();
+	for (_domain& d : _domains)
+		std::fill(d.fetching.begin(), d.fetching.end(), 0);
+	// A callback can make another read, it waits for a new fetch
+	std::vector<_waiting_read> failed;
+	failed.swap(_waiting);
+	std::shared_ptr<bool> alive = _alive;
+	for (_waiting_read& waiting : failed)
+	{
+		waiting.callback(false, nullptr, 0);
+		if (*alive == false)
+			return;
+	}
+}
+
+
+void memory_mirror::read(const std::string& domain, uint32_t address, uint32_t size, clock::duration max_age, read_callback callback)
+{
+	_domain* d = _find(domain);
+	size_t first, last;
+	if (d == nullptr || _blocks(*d, address, size, first, last) == false)
+	{
+		callback(false, nullptr, 0);
+		return;
+	}
+	clock::time_point now = clock::now();
+	auto stale = [&](size_t block) {
+		const clock::time_point& t = d->read_times[block];
+		return t == clock::time_point() || now - t > max_age;
+	};
+	size_t index = d - _domains.data();
+	bool waiting = false;
+	bool queued = false;
+	size_t block = first;
+	while (block < last)
+	{
+		if (d->fetching[block])
+		{
+			// Another read already asked for it
+			waiting = true;
+			block++;
+			continue;
+		}
+		if (stale(block) == false)
+		{
+			block++;
+			continue;
+		}
+		size_t run_end = block + 1;
+		while (run_end < last && d->fetching[run_end] == 0 && stale(run_end))
+			run_end++;
+		std::fill(d->fetching.begin() + block, d->fetching.begin() + run_end, 1);
+		size_t begin = block << _block_shift;
+		size_t end = std::min(run_end << _block_shift, d->memory.size());
+		_queued.push_back(read_planner::request{index, (uint32_t) begin, (uint32_t) (end - begin)});
+		queued = true;
+		block = run_end;
+	}
+	if (waiting == false && queued == false)
+	{
+		_stats.hits++;
+		callback(true, d->memory.data() + address, size);
+		return;
+	}
+	_stats.misses++;
+	if (queued == false)
+		_stats.joined++;
+	_waiting.push_back(_waiting_read{index, address, size, first, last, true, std::move(callback)});
+	if (queued && _send_posted == false)
+	{
+		// The stale ranges of the reads made until the current handler returns are sent together
+		_send_posted = true;
+		// The handler can run after the mirror is gone, it does not use memory of the mirror
+		asio::post(_io_service, [this, alive = _alive] {
+			if (*alive)
+				_send_queued();
+		});
+	}
+}
+
+
+void memory_mirror::_send_queued()
+{
+	_send_posted = false;
+	if (_queued.empty())
+		return;
+	_planner.plan(_queued);
+	const auto& commands = _planner.commands();
+	std::vector<_fetch> fetches(commands.size());
+	for (size_t i = 0; i < _queued.size(); i++)
+		fetches[_planner.request_command(i)].requests.push_back(_queued[i]);
+	_queued.clear();
+
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		const read_planner::command& command = commands[i];
+		_fetch& fetch = fetches[i];
+		fetch.domain = command.domain;
+		std::string args = _domains[command.domain].name;
+		for (size_t r = command.first_range; r < command.first_range + command.range_count; r++)
+		{
+			read_planner::range range = _planner.ranges()[r];
+			args.push_back(';');
+			append_hex_argument(args, range.address);
+			args.push_back(';');
+			append_hex_argument(args, range.size);
+			range.offset -= command.offset;
+			fetch.ranges.push_back(range);
+		}
+		fetch.buffer = _pool.allocate(command.size);
+		fetch.generation = _fetch_generation;
+		_stats.commands++;
+		asio::mutable_buffer buffer(fetch.buffer.data(), command.size);
+		_client.read_into("CORE_READ", args, buffer, [this, alive = _alive, fetch = std::move(fetch)](const reply& r) mutable {
+			if (*alive)
+				_fetch_done(fetch, r);
+		});
+	}
+}
+
+
+void memory_mirror::_fetch_done(_fetch& fetch, const reply& r)
+{
+	// Its blocks and reads were reset, they can belong to a newer fetch
+	if (fetch.generation != _fetch_generation)
+		return;
+	_domain& d = _domains[fetch.domain];
+	bool success = r.is_binary();
+	if (success)
+	{
+		_stats.bytes_fetched += r.binary_size;
+		clock::time_point now = clock::now();
+		for (const read_planner::range& range : fetch.ranges)
+		{
+			memcpy(d.memory.data() + range.address, fetch.buffer.data() + range.offset, range.size);
+			size_t first, last;
+			_blocks(d, range.address, range.size, first, last);
+			std::fill(d.read_times.begin() + first, d.read_times.begin() + last, now);
+		}
+	}
+	for (const read_planner::request& request : fetch.requests)
+	{
+		size_t first, last;
+		_blocks(d, request.address, request.size, first, last);
+		std::fill(d.fetching.begin() + first, d.fetching.begin() + last, 0);
+		if (success)
+			continue;
+		for (_waiting_read& waiting : _waiting)
+		{
+			if (waiting.domain == fetch.domain && waiting.first < last && waiting.last > first)
+				waiting.success = false;
+		}
+	}
+
+	// The reads that do not wait for any block anymore, a callback can make another read
+	std::vector<_waiting_read> ready;
+	ready.swap(_ready);
+	for (size_t i = 0; i < _waiting.size();)
+	{
+		_waiting_read& waiting = _waiting[i];
+		const _domain& wd = _domains[waiting.domain];
+		if (std::find(wd.fetching.begin() + waiting.first, wd.fetching.begin() + waiting.last, 1) != wd.fetching.begin() + waiting.last)
+		{
+			i++;
+			continue;
+		}
+		ready.push_back(std::move(waiting));
+		_waiting.erase(_waiting.begin() + i);
+	}
+	std::shared_ptr<bool> alive = _alive;
+	for (_waiting_read& waiting : ready)
+	{
+		if (waiting.success)
+			waiting.callback(true, _domains[waiting.domain].memory.data() + waiting.address, waiting.size);
+		else
+			waiting.callback(false, nullptr, 0);
+		// A callback can destroy the mirror
+		if (*alive == false)
+			return;
+	}
+	ready.clear();
+	_ready.swap(ready);
+}
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nwaasiobuffer.h"
+#include "nwaasioclient.h"
+#include "nwaasiofunction.h"
+#include "nwaasioreadplanner.h"
+
+namespace nwaasio {
+    /**
+     * @brief A local copy of the memory domains of the emulator
+     *
+     * Each domain is a contiguous block of local memory split in blocks that remember when they
+     * were last read from the emulator. A read whose blocks are recent enough is answered from the
+     * local memory without sending anything. Otherwise its stale blocks are marked as being fetched
+     * and the read waits for them, a later read that needs the same blocks waits for the same fetch
+     * instead of asking again. The stale blocks of all the reads made during a handler run are read
+     * together with a read_planner, in as few multi-range CORE_READ as possible, once the handler
+     * returns. Several users can share a mirror to share the bandwidth of the connection.
+     * The replies go in a staging buffer and are copied in the local memory when complete, so the
+     * local memory only changes between two handlers.
+     */
+    class memory_mirror {
+    public:
+        using clock = std::chrono::steady_clock;
+        /**
+         * @brief The function called with the data of a read, the data is valid until the mirror handles another reply
+         */
+        using read_callback = unique_function<void(bool success, const uint8_t* data, size_t size)>;
+        using done_callback = unique_function<void(bool success)>;
+        struct stats {
+            // The reads answered from the local memory
+            uint64_t	hits = 0;
+            // The reads that waited for blocks from the emulator
+            uint64_t	misses = 0;
+            // The misses whose blocks were all already being fetched for other reads
+            uint64_t	joined = 0;
+            uint64_t	commands = 0;
+            uint64_t	bytes_fetched = 0;
+        };
+
+        /**
+         * @brief Create a mirror without any domain, see init and add_domain
+         * @param io_service The asio io service context of the client
+         * @param c The client used to read the memory, it must outlive the mirror
+         * @param block_size The size of the blocks whose age is tracked, a power of two
+         */
+        memory_mirror(asio::io_service& io_service, client& c, size_t block_size = 256);
+        /**
+         * @brief The replies that arrive after the mirror is destroyed are ignored, the waiting reads are not called
+         */
+        ~memory_mirror();
+        memory_mirror(const memory_mirror&) = delete;
+        memory_mirror& operator=(const memory_mirror&) = delete;
+
+        /**
+         * @brief Create the domains from the reply of CORE_MEMORIES, call it before any read
+         * @param done An optionnal callback called when the domains are created
+         */
+        void	init(done_callback done = nullptr);
+        /**
+         * @brief Create a domain, or clear it if it exists, it must not be called while a read is in progress
+         */
+        void	add_domain(const std::string& name, size_t size);
+        bool	has_domain(const std::string& name) const { return _find(name) != nullptr; }
+        size_t	domain_size(const std::string& name) const;
+        /**
+         * @brief The local memory of a domain, nullptr if the domain does not exist
+         */
+        const uint8_t*	data(const std::string& name) const;
+
+        /**
+         * @brief Read through the mirror
+         * @param domain The memory domain, like WRAM
+         * @param address The address of the data in the domain
+         * @param size The size of the data
+         * @param max_age How old the local data can be, 0 always waits for a read from the emulator
+         * @param callback Called with the data, right away if the local data is recent enough
+         */
+        void	read(const std::string& domain, uint32_t address, uint32_t size, clock::duration max_age, read_callback callback);
+        /**
+         * @brief Tell if a range is in the local memory and not older than max_age
+         */
+        bool	fresh(const std::string& domain, uint32_t address, uint32_t size, clock::duration max_age) const;
+        /**
+         * @brief When the oldest block of a range was read, clock::time_point() if it never was
+         */
+        clock::time_point	read_time(const std::string& domain, uint32_t address, uint32_t size) const;
+        /**
+         * @brief Forget that a range was read, the next read of it asks the emulator, or waits for a fetch in progress
+         */
+        void	invalidate(const std::string& domain, uint32_t address, uint32_t size);
+        /**
+         * @brief Forget that anything was read, and the fetches in progress
+         * The replies of these fetches are ignored and the reads waiting for them are called with success false.
+         * When the client loses the connection, its failed replies do the same for the fetches it sent.
+         */
+        void	invalidate();
+        /**
+         * @brief Set the largest gap between two stale ranges that are read as a single range, see read_planner
+         */
+        void	set_gap_threshold(uint32_t bytes) { _planner.set_gap_threshold(bytes); }
+        /**
+         * @brief Set the limits of a single CORE_READ, see read_planner
+         */
+        void	set_command_limits(size_t max_ranges, size_t max_bytes) { _planner.set_command_limits(max_ranges, max_bytes); }
+        const stats&	statistics() const { return _stats; }
+
+    private:
+        struct _domain {
+            std::string					name;
+            std::vector<uint8_t>		memory;
+            // When each block was read, time_point() for never
+            std::vector<clock::time_point>	read_times;
+            // 1 for the blocks a fetch was asked for and has not replied yet
+            std::vector<uint8_t>		fetching;
+        };
+        // A read waiting for blocks being fetched
+        struct _waiting_read {
+            size_t			domain;
+            uint32_t		address;
+            uint32_t		size;
+            size_t			first;
+            size_t			last;
+            bool			success;
+            read_callback	callback;
+        };
+        // A CORE_READ in flight, its ranges are relative to its buffer
+        struct _fetch {
+            size_t		domain;
+            std::vector<read_planner::range>	ranges;
+            // The stale ranges it was asked for, their blocks are not fetching anymore once it replied
+            std::vector<read_planner::request>	requests;
+            payload		buffer;
+            // The value of _fetch_generation when it was sent
+            uint64_t	generation = 0;
+        };
+        asio::io_service&		_io_service;
+        client&					_client;
+        size_t					_block_shift;
+        std::vector<_domain>	_domains;
+        // The stale ranges of the reads of the current handler run, sent once it returns
+        std::vector<read_planner::request>	_queued;
+        bool					_send_posted = false;
+        read_planner			_planner;
+        buffer_pool				_pool;
+        std::vector<_waiting_read>	_waiting;
+        std::vector<_waiting_read>	_ready;
+        // Changed when the fetches in progress are forgotten, their replies are then ignored
+        uint64_t				_fetch_generation = 0;
+        // The callbacks check it before touching the mirror
+        std::shared_ptr<bool>	_alive = std::make_shared<bool>(true);
+        stats					_stats;
+
+        void			_send_queued();
+        void			_fetch_done(_fetch& fetch, const reply& r);
+        void			_reset_fetches();
+
+        const _domain*	_find(const std::string& name) const;
+        _domain*		_find(const std::string& name);
+        // The blocks of a range clamped to the domain, last is excluded
+        bool			_blocks(const _domain& d, uint32_t address, uint32_t size, size_t& first, size_t& last) const;
+    };
+}
@@ -0,0 +1,139 @@
+#include <cstring>
+#include "nwaasioparser.h"
+#include "nwaasiosimd.h"
+
+namespace nwaasio {
+
+#if defined(NWAASIO_USE_SSE2) || defined(NWAASIO_USE_AVX2)
+// Look at the newline and colon masks of a chunk, return true if the line ends in it
+static inline bool scan_masks(const char* chunk, uint32_t newlines, uint32_t colons, const char*& colon, const char*& found)
+{
+	if (newlines != 0)
+		colons &= (newlines & (0 - newlines)) - 1; // only the colons before the first newline
+	if (colon == nullptr && colons != 0)
+		colon = chunk + count_trailing_zeros(colons);
+	if (newlines != 0)
+	{
+		found = chunk + count_trailing_zeros(newlines);
+		return true;
+	}
+	return false;
+}
+#endif
+
+
+const char* scan_line(const char* data, const char* end, const char*& colon)
+{
+	const char* p = data;
+	const char* found = nullptr;
+#if defined(NWAASIO_USE_AVX2)
+	const __m256i newline32 = _mm256_set1_epi8('\n');
+	const __m256i colon32 = _mm256_set1_epi8(':');
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+		uint32_t newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline32));
+		uint32_t colons = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, colon32));
+		if (scan_masks(p, newlines, colons, colon, found))
+			return found;
+	}
+#endif
+#if defined(NWAASIO_USE_SSE2)
+	const __m128i newline16 = _mm_set1_epi8('\n');
+	const __m128i colon16 = _mm_set1_epi8(':');
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		uint32_t newlines = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline16));
+		uint32_t colons = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, colon16));
+		if (scan_masks(p, newlines, colons, colon, found))
+			return found;
+	}
+#endif
+	found = (const char*)memchr(p, '\n', end - p);
+	if (found == nullptr)
+		found = end;
+	if (colon == nullptr)
+		colon = (const char*)memchr(p, ':', found - p);
+	return found;
+}
+
+
+void ascii_parser::reset()
+{
+	_line_start = 0;
+	_separator = 0;
+	_has_separator = false;
+	_line_started = false;
+	_done = false;
+}
+
+
+size_t ascii_parser::parse(const char* data, size_t size, reply& r)
+{
+	const char* p = data;
+	const char* end = data + size;
+	while (p != end && _done == false)
+	{
+		if (_line_started == false)
+		{
+			_line_start = (uint32_t)r._ascii_text.size();
+			_has_separator = false;
+			_line_started = true;
+		}
+		// A non null colon tells scan_line to not look for it again
+		const char* colon = _has_separator ? p : nullptr;
+		const char* newline = scan_line(p, end, colon);
+		if (colon != nullptr && _has_separator == false)
+		{
+			_separator = (uint32_t)(r._ascii_text.size() + (colon - p));
+			_has_separator = true;
+		}
+		r._ascii_text.append(p, newline - p);
+		if (newline == end)
+			return size;
+		p = newline + 1;
+		_line_done(r);
+	}
+	return p - data;
+}
+
+
+void ascii_parser::_line_done(reply& r)
+{
+	_line_started = false;
+	uint32_t line_end = (uint32_t)r._ascii_text.size();
+	if (line_end == _line_start)
+	{
+		_done = true;
+		return;
+	}
+	uint32_t separator = _has_separator ? _separator : line_end;
+	std::string_view text(r._ascii_text);
+	std::string_view key = text.substr(_line_start, separator - _line_start);
+	std::string_view value = _has_separator ? text.substr(separator + 1, line_end - separator - 1) : std::string_view();
+	if (key == "error")
+	{
+		r.type = reply::reply_type::AERROR;
+		if (value == "protocol_error")
+			r.error_type = error_type::PROTOCOL_ERROR;
+		if (value == "not_allowed")
+			r.error_type = error_type::NOT_ALLOWED;
+		if (value == "invalid_command")
+			r.error_type = error_type::INVALID_COMMAND;
+		if (value == "invalid_argument")
+			r.error_type = error_type::INVALID_ARGUMENT;
+		if (value == "command_error")
+			r.error_type = error_type::COMMAND_ERROR;
+	}
+	if (key == "reason" && r.type == reply::reply_type::AERROR)
+	{
+		r.error_reason = value;
+	}
+	if (r.type != reply::reply_type::AERROR)
+		r._add_ascii_entry(_line_start, separator);
+	else
+		r._ascii_text.resize(_line_start);
+}
+
+}
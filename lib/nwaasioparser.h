@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "nwaasio.h"
+
+namespace nwaasio {
+    /**
+     * @brief A resumable parser for the body of an ascii reply, the part after its first '\n'
+     *
+     * The data can be given in fragments of any size, the lines are written directly in the
+     * entries storage of the reply so nothing is allocated per line. Error replies are detected
+     * and their error_type and error_reason are filled.
+     */
+    class ascii_parser {
+    public:
+        /**
+         * @brief Start a new reply
+         */
+        void	reset();
+        /**
+         * @brief Parse a fragment of the reply
+         * @param data The received data
+         * @param size The size of data
+         * @param r The reply to fill, it must be the same until the reply is done
+         * @return The number of bytes used, it's less than size only if the reply is done
+         */
+        size_t	parse(const char* data, size_t size, reply& r);
+        /**
+         * @brief true when the empty line ending the reply has been parsed
+         */
+        bool	done() const { return _done; }
+
+    private:
+        // Where the current line starts in the reply storage, and its ':' if already found
+        uint32_t	_line_start = 0;
+        uint32_t	_separator = 0;
+        bool		_has_separator = false;
+        bool		_line_started = false;
+        bool		_done = false;
+
+        void	_line_done(reply& r);
+    };
+
+    /**
+     * @brief Find the first '\n' in [data, end) using SIMD when available
+     * @param colon Set to the first ':' before this '\n' if there is one, untouched otherwise
+     * @return The position of the '\n', or end
+     */
+    const char* scan_line(const char* data, const char* end, const char*& colon);
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "nwaasio.h"
+#include "nwaasioprepared.h"
+
+namespace nwaasio {
+
+prepared_command::prepared_command(const std::string& command, const std::string& args)
+	: _name(command), _text(std::make_shared<std::string>())
+{
+	_text->reserve(command.size() + args.size() + 2);
+	_text->append(command);
+	if (args.empty() == false)
+	{
+		_text->push_back(' ');
+		_text->append(args);
+	}
+	_text->push_back('\n');
+	if (args.empty() == false)
+		_parse_arguments(command.size() + 1);
+}
+
+
+prepared_command::prepared_command(const std::string& command, const std::list<std::string>& args)
+	: _name(command), _text(std::make_shared<std::string>(command))
+{
+	for (const std::string& arg : args)
+	{
+		_text->push_back(_text->size() == command.size() ? ' ' : ';');
+		_text->append(arg);
+	}
+	_text->push_back('\n');
+	if (args.empty() == false)
+		_parse_arguments(command.size() + 1);
+}
+
+
+void prepared_command::_parse_arguments(size_t begin)
+{
+	const std::string& text = *_text;
+	size_t end = text.size() - 1;
+	while (true)
+	{
+		size_t separator = text.find(';', begin);
+		if (separator == std::string::npos || separator > end)
+			separator = end;
+		_arguments.push_back(field{(uint32_t) begin, (uint32_t) (separator - begin)});
+		if (separator == end)
+			break;
+		begin = separator + 1;
+	}
+}
+
+
+std::string& prepared_command::_writable_text()
+{
+	// A command waiting to be sent still uses the current text
+	if (_text.use_count() > 1)
+		_text = std::make_shared<std::string>(*_text);
+	return *_text;
+}
+
+
+std::string_view prepared_command::argument(size_t index) const
+{
+	const field& f = _arguments.at(index);
+	return std::string_view(_text->data() + f.begin, f.size);
+}
+
+
+void prepared_command::set_argument(size_t index, std::string_view value)
+{
+	field& f = _arguments.at(index);
+	std::string& text = _writable_text();
+	text.replace(f.begin, f.size, value.data(), value.size());
+	int32_t shift = (int32_t) value.size() - (int32_t) f.size;
+	f.size = (uint32_t) value.size();
+	for (size_t i = index + 1; i < _arguments.size(); i++)
+		_arguments[i].begin += shift;
+}
+
+
+void prepared_command::set_hex_argument(size_t index, uint64_t value)
+{
+	char digits[16];
+	size_t digit_count = number_to_hex_chars(value, digits);
+
+	const field& f = _arguments.at(index);
+	if (f.size > digit_count && (*_text)[f.begin] == '$')
+	{
+		char* field_digits = &_writable_text()[f.begin + 1];
+		size_t padding = f.size - 1 - digit_count;
+		std::fill(field_digits, field_digits + padding, '0');
+		std::copy(digits, digits + digit_count, field_digits + padding);
+		return;
+	}
+	char field_text[18] = {'$'};
+	std::copy(digits, digits + digit_count, field_text + 1);
+	set_argument(index, std::string_view(field_text, digit_count + 1));
+}
+
+}
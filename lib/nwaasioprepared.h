@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nwaasio {
+    /**
+     * @brief A command formatted once and sent as many times as needed without formatting it again
+     *
+     * The arguments can be changed in place, set_hex_argument writes a number in the existing field
+     * when it fits, to update an address or a size without rebuilding the whole command.
+     * The client shares the formatted text with the commands it has not sent yet, changing a
+     * prepared command that is still waiting to be sent copies its text first.
+     */
+    class prepared_command {
+    public:
+        /**
+         * @brief Prepare a command
+         * @param command The command
+         * @param args the argument, note that you can pass a nwa formated string of arguments
+         */
+        explicit prepared_command(const std::string& command, const std::string& args = std::string());
+        /**
+         * @brief Prepare a command
+         * @param command The command
+         * @param args A list of arguments to pass to the command
+         */
+        prepared_command(const std::string& command, const std::list<std::string>& args);
+
+        const std::string&	name() const { return _name; }
+        /**
+         * @brief The text sent to the emulator, with its ending newline
+         */
+        const std::string&	text() const { return *_text; }
+        size_t				argument_count() const { return _arguments.size(); }
+        std::string_view	argument(size_t index) const;
+        /**
+         * @brief Replace an argument
+         * @param index the argument position, arguments are separated by ;
+         * @param value the new value
+         */
+        void				set_argument(size_t index, std::string_view value);
+        /**
+         * @brief Replace an argument by a number in hexadecimal like $1F
+         * The number is written in place, padded with 0, if the argument is already an hexadecimal
+         * number with enough digits. Prepare the command with wide enough fields, like $000000,
+         * so the updates do not change the size of the command.
+         * @param index the argument position, arguments are separated by ;
+         * @param value the number
+         */
+        void				set_hex_argument(size_t index, uint64_t value);
+
+    private:
+        friend class client;
+        struct field {
+            uint32_t	begin;
+            uint32_t	size;
+        };
+        std::string					_name;
+        std::shared_ptr<std::string>	_text;
+        std::vector<field>			_arguments;
+
+        void			_parse_arguments(size_t begin);
+        std::string&	_writable_text();
+    };
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include "nwaasioreadbatch.h"
+
+namespace nwaasio {
+
+read_batch::~read_batch()
+{
+	cancel();
+}
+
+
+size_t read_batch::add(const std::string& domain, uint32_t address, uint32_t size, read_callback callback)
+{
+	auto it = std::find(_domains.begin(), _domains.end(), domain);
+	if (it == _domains.end())
+		it = _domains.insert(_domains.end(), domain);
+	_reads.push_back(_read{(size_t) (it - _domains.begin()), address, size, 0, std::move(callback)});
+	_dirty = true;
+	return _reads.size() - 1;
+}
+
+
+void read_batch::clear()
+{
+	// The reads of a send in progress are gone, its replies can not be dispatched anymore
+	cancel();
+	_domains.clear();
+	_reads.clear();
+	_clear_count++;
+	_dirty = true;
+}
+
+
+void read_batch::cancel()
+{
+	if (busy())
+	{
+		// The commands in flight still write in the old buffer, the next send uses a new one
+		_send->cancelled = true;
+		auto send = std::make_shared<_send_state>();
+		send->buffer.resize(_send->buffer.size());
+		_send = std::move(send);
+	}
+	_done = nullptr;
+}
+
+
+size_t read_batch::command_count()
+{
+	if (_dirty && busy() == false)
+		_build_commands();
+	return _commands.size();
+}
+
+
+void read_batch::set_command_limits(size_t max_ranges, size_t max_bytes)
+{
+	_planner.set_command_limits(max_ranges, max_bytes);
+	_dirty = true;
+}
+
+
+void read_batch::set_gap_threshold(uint32_t bytes)
+{
+	_planner.set_gap_threshold(bytes);
+	_dirty = true;
+}
+
+
+const read_planner::stats& read_batch::plan_stats()
+{
+	if (_dirty && busy() == false)
+		_build_commands();
+	return _planner.statistics();
+}
+
+
+void read_batch::_build_commands()
+{
+	_requests.clear();
+	for (const _read& read : _reads)
+		_requests.push_back(read_planner::request{read.domain, read.address, read.size});
+	_planner.plan(_requests);
+
+	_commands.clear();
+	for (const read_planner::command& planned : _planner.commands())
+	{
+		std::string args = _domains[planned.domain];
+		for (size_t i = planned.first_range; i < planned.first_range + planned.range_count; i++)
+		{
+			const read_planner::range& range = _planner.ranges()[i];
+			args.push_back(';');
+			append_hex_argument(args, range.address);
+			args.push_back(';');
+			append_hex_argument(args, range.size);
+		}
+		_commands.push_back(_command{prepared_command("CORE_READ", args), planned.offset, planned.size, {}});
+	}
+	for (size_t i = 0; i < _reads.size(); i++)
+	{
+		_reads[i].offset = _planner.request_offset(i);
+		_commands[_planner.request_command(i)].reads.push_back(i);
+	}
+	_send->buffer.resize(_planner.buffer_size());
+	_dirty = false;
+}
+
+
+bool read_batch::send(client& c, done_callback done)
+{
+	if (busy())
+		return false;
+	if (_dirty)
+		_build_commands();
+	if (_commands.empty())
+		return false;
+	_success = true;
+	_error_reason.clear();
+	_done = std::move(done);
+	_send->pending_commands = _commands.size();
+	for (size_t i = 0; i < _commands.size(); i++)
+	{
+		const _command& command = _commands[i];
+		// The callback does not touch the batch once the send is cancelled, the batch can be gone
+		c.read_into(command.command, asio::buffer(_send->buffer.data() + command.offset, command.size),
+			[this, i, send = _send](const reply& r) {
+				if (send->cancelled)
+					return;
+				_command_done(i, r);
+			});
+	}
+	return true;
+}
+
+
+void read_batch::_command_done(size_t index, const reply& r)
+{
+	// A read callback can cancel the send, keep what the loop uses alive
+	std::shared_ptr<_send_state> send = _send;
+	if (r.is_binary())
+	{
+		// A callback can clear the batch or add to it, nothing is kept across a call
+		for (size_t i = 0; i < _commands[index].reads.size(); i++)
+		{
+			size_t read_index = _commands[index].reads[i];
+			// The callback must not be destroyed or moved while it runs
+			read_callback callback = std::move(_reads[read_index].callback);
+			if (callback == nullptr)
+				continue;
+			size_t clear_count = _clear_count;
+			callback(send->buffer.data() + _reads[read_index].offset, _reads[read_index].size);
+			if (_clear_count == clear_count)
+				_reads[read_index].callback = std::move(callback);
+			if (send->cancelled)
+				return;
+		}
+	}
+	else {
+		_success = false;
+		_error_reason = r.error_reason.empty() ? "CORE_READ did not reply with binary data" : r.error_reason;
+	}
+	if (--send->pending_commands == 0 && _done != nullptr)
+	{
+		done_callback done = std::move(_done);
+		_done = nullptr;
+		done(_success);
+	}
+}
+
+}
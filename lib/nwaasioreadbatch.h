@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nwaasioclient.h"
+#include "nwaasiofunction.h"
+#include "nwaasioprepared.h"
+#include "nwaasioreadplanner.h"
+
+namespace nwaasio {
+    /**
+     * @brief A set of memory reads sent together as multi-range CORE_READ commands
+     *
+     * Each read is a domain, an address and a size. A read_planner merges the reads that overlap
+     * or are close and groups them in as few commands as possible, the binary replies are written
+     * directly in the batch memory, then each read gets its own part of the data. The commands are built once and sent again as
+     * they are until the reads change, so a batch can be sent every frame to poll variables.
+     */
+    class read_batch {
+    public:
+        /**
+         * @brief The function called with the data of a read, the data is valid until the batch is sent again
+         * It can add reads, clear the batch or cancel the send, the reads left in the send are then not called.
+         */
+        using read_callback = unique_function<void(const uint8_t* data, size_t size)>;
+        /**
+         * @brief The function called once all the commands of the batch got their reply
+         */
+        using done_callback = unique_function<void(bool success)>;
+
+        read_batch() = default;
+        ~read_batch();
+        read_batch(const read_batch&) = delete;
+        read_batch& operator=(const read_batch&) = delete;
+
+        /**
+         * @brief Add a read to the batch
+         * @param domain The memory domain, like WRAM
+         * @param address The address of the data in the domain
+         * @param size The size of the data
+         * @param callback An optionnal callback called with the data when its command got its reply
+         * @return the index of the read, to use with data()
+         */
+        size_t		add(const std::string& domain, uint32_t address, uint32_t size, read_callback callback = nullptr);
+        /**
+         * @brief Remove all the reads, this cancels the send in progress
+         */
+        void		clear();
+        size_t		count() const { return _reads.size(); }
+        /**
+         * @brief How many commands the batch sends, this builds them if the reads changed
+         */
+        size_t		command_count();
+        /**
+         * @brief Set the limits of a single command, a read bigger than max_bytes gets its own command
+         * @param max_ranges The maximum number of offset;size pairs in a command, the default is 64
+         * @param max_bytes The maximum size of the data of a command, the default is 64 KiB
+         */
+        void		set_command_limits(size_t max_ranges, size_t max_bytes);
+        /**
+         * @brief Set the largest gap between two reads that are read as a single range, see read_planner
+         */
+        void		set_gap_threshold(uint32_t bytes);
+        /**
+         * @brief The counters of the plan of the commands, this builds them if the reads changed
+         */
+        const read_planner::stats&	plan_stats();
+        /**
+         * @brief Send the commands of the batch
+         * Nothing is sent if the batch is empty or if the previous send is not done yet. The replies
+         * that arrive after the batch is destroyed or the send cancelled are ignored.
+         * @param c The client used to send the commands
+         * @param done An optionnal callback called once all the commands got their reply
+         * @return true if the commands are sent
+         */
+        bool		send(client& c, done_callback done = nullptr);
+        bool		busy() const { return _send->pending_commands != 0; }
+        /**
+         * @brief Forget the commands sent, their replies are ignored and neither the read callbacks nor done
+         * are called. To send the batch again after the client lost the connection
+         */
+        void		cancel();
+        /**
+         * @brief The data of a read from the last send, only valid if the command of the read succeeded
+         */
+        const uint8_t*	data(size_t index) const { return _send->buffer.data() + _reads[index].offset; }
+        size_t			size(size_t index) const { return _reads[index].size; }
+        /**
+         * @brief The reason of the last failed command, empty if all the commands succeeded
+         */
+        const std::string&	error_reason() const { return _error_reason; }
+
+    private:
+        struct _read {
+            size_t			domain;
+            uint32_t		address;
+            uint32_t		size;
+            // Where the data of the read is in the buffer of the send
+            size_t			offset;
+            read_callback	callback;
+        };
+        struct _command {
+            prepared_command	command;
+            size_t				offset;
+            size_t				size;
+            // The reads whose data comes from this command
+            std::vector<size_t>	reads;
+        };
+        std::vector<std::string>	_domains;
+        std::vector<_read>			_reads;
+        std::vector<_command>		_commands;
+        bool						_dirty = false;
+        read_planner				_planner;
+        std::vector<read_planner::request>	_requests;
+        // What the reply callbacks of a send share, a cancelled send keeps its buffer until its last reply
+        struct _send_state {
+            std::vector<uint8_t>	buffer;
+            size_t					pending_commands = 0;
+            bool					cancelled = false;
+        };
+        std::shared_ptr<_send_state>	_send = std::make_shared<_send_state>();
+        bool						_success = true;
+        std::string					_error_reason;
+        done_callback				_done;
+        // Counts the calls to clear, a read callback running during one is not put back
+        size_t						_clear_count = 0;
+
+        void	_build_commands();
+        void	_command_done(size_t index, const reply& r);
+    };
+}
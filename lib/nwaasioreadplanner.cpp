@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <numeric>
+#include "nwaasioreadplanner.h"
+
+namespace nwaasio {
+
+void read_planner::set_command_limits(size_t max_ranges, size_t max_bytes)
+{
+	_max_ranges = std::max(max_ranges, (size_t) 1);
+	_max_bytes = std::max(max_bytes, (size_t) 1);
+}
+
+
+void read_planner::plan(const request* requests, size_t count)
+{
+	_order.resize(count);
+	std::iota(_order.begin(), _order.end(), 0);
+	std::sort(_order.begin(), _order.end(), [requests](size_t a, size_t b) {
+		if (requests[a].domain != requests[b].domain)
+			return requests[a].domain < requests[b].domain;
+		return requests[a].address < requests[b].address;
+	});
+
+	// Merge the sorted requests, _request_commands holds the range of each request for now
+	_ranges.clear();
+	_range_domains.clear();
+	_request_offsets.resize(count);
+	_request_commands.resize(count);
+	_stats = stats();
+	_stats.requests = count;
+	for (size_t index : _order)
+	{
+		const request& r = requests[index];
+		uint64_t end = (uint64_t) r.address + r.size;
+		_stats.requested_bytes += r.size;
+		bool merge = false;
+		if (_ranges.empty() == false && _range_domains.back() == r.domain)
+		{
+			range& current = _ranges.back();
+			uint64_t current_end = (uint64_t) current.address + current.size;
+			if (r.address <= current_end + _gap_threshold)
+			{
+				uint64_t merged_end = std::max(current_end, end);
+				if (merged_end == current_end || merged_end - current.address <= _max_bytes)
+				{
+					current.size = (uint32_t) (merged_end - current.address);
+					merge = true;
+				}
+			}
+		}
+		if (merge == false)
+		{
+			_ranges.push_back(range{r.address, r.size, 0});
+			_range_domains.push_back(r.domain);
+		}
+		_request_commands[index] = _ranges.size() - 1;
+	}
+
+	// Group the ranges into commands and lay their data one after the other
+	_commands.clear();
+	_range_commands.resize(_ranges.size());
+	size_t offset = 0;
+	for (size_t i = 0; i < _ranges.size(); i++)
+	{
+		range& r = _ranges[i];
+		if (_commands.empty() || _commands.back().domain != _range_domains[i] || _commands.back().range_count == _max_ranges
+			|| _commands.back().size + r.size > _max_bytes)
+		{
+			_commands.push_back(command{_range_domains[i], i, 0, offset, 0});
+		}
+		command& c = _commands.back();
+		c.range_count++;
+		c.size += r.size;
+		r.offset = offset;
+		offset += r.size;
+		_range_commands[i] = _commands.size() - 1;
+		_stats.read_bytes += r.size;
+	}
+	_buffer_size = offset;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const range& r = _ranges[_request_commands[i]];
+		_request_offsets[i] = r.offset + (requests[i].address - r.address);
+		_request_commands[i] = _range_commands[_request_commands[i]];
+	}
+	_stats.ranges = _ranges.size();
+	_stats.commands = _commands.size();
+}
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nwaasio {
+    /**
+     * @brief Plans the CORE_READ commands needed to read a set of memory ranges
+     *
+     * The ranges are sorted, the ones that overlap or are separated by a gap of at most the gap threshold
+     * are merged into a single range, then the merged ranges are grouped into commands. Reading the
+     * bytes of a small gap costs less than another offset;size pair and its handling by the emulator,
+     * the threshold sets the trade between the two. The data of all the commands goes in one buffer,
+     * the planner tells where the data of each requested range is in it.
+     */
+    class read_planner {
+    public:
+        struct request {
+            // An identifier of the memory domain, requests of different domains are never merged
+            size_t		domain;
+            uint32_t	address;
+            uint32_t	size;
+        };
+        struct range {
+            uint32_t	address;
+            uint32_t	size;
+            // Where the data of the range goes in the buffer
+            size_t		offset;
+        };
+        struct command {
+            size_t		domain;
+            // The ranges of the command in ranges()
+            size_t		first_range;
+            size_t		range_count;
+            // Where the data of the command goes in the buffer
+            size_t		offset;
+            size_t		size;
+        };
+        struct stats {
+            uint64_t	requests = 0;
+            uint64_t	ranges = 0;
+            uint64_t	commands = 0;
+            // The sum of the size of the requests
+            uint64_t	requested_bytes = 0;
+            // What the commands read, with the gaps, without the overlaps
+            uint64_t	read_bytes = 0;
+            /**
+             * @brief The bytes read for each requested byte, it is below 1 when requests overlap
+             */
+            double		amplification() const { return requested_bytes == 0 ? 1.0 : (double) read_bytes / requested_bytes; }
+        };
+
+        /**
+         * @brief Set the largest gap between two ranges that still merges them, a gap of exactly this size merges. The default is 16 bytes
+         */
+        void	set_gap_threshold(uint32_t bytes) { _gap_threshold = bytes; }
+        uint32_t	gap_threshold() const { return _gap_threshold; }
+        /**
+         * @brief Set the limits of a single command, a range bigger than max_bytes gets its own command
+         * @param max_ranges The maximum number of offset;size pairs in a command, the default is 64
+         * @param max_bytes The maximum size of the data of a command, ranges are not merged above it, the default is 64 KiB
+         */
+        void	set_command_limits(size_t max_ranges, size_t max_bytes);
+        /**
+         * @brief Plan the reads of the requests, this replaces the previous plan
+         */
+        void	plan(const request* requests, size_t count);
+        void	plan(const std::vector<request>& requests) { plan(requests.data(), requests.size()); }
+
+        const std::vector<range>&	ranges() const { return _ranges; }
+        const std::vector<command>&	commands() const { return _commands; }
+        /**
+         * @brief Where the data of a request is in the buffer
+         */
+        size_t	request_offset(size_t index) const { return _request_offsets[index]; }
+        /**
+         * @brief The command that reads a request
+         */
+        size_t	request_command(size_t index) const { return _request_commands[index]; }
+        /**
+         * @brief The size of the buffer that receives the data of all the commands
+         */
+        size_t	buffer_size() const { return _buffer_size; }
+        const stats&	statistics() const { return _stats; }
+
+    private:
+        uint32_t	_gap_threshold = 16;
+        size_t		_max_ranges = 64;
+        size_t		_max_bytes = 64 * 1024;
+
+        std::vector<size_t>		_order;
+        std::vector<range>		_ranges;
+        std::vector<size_t>		_range_domains;
+        std::vector<size_t>		_range_commands;
+        std::vector<command>	_commands;
+        std::vector<size_t>		_request_offsets;
+        std::vector<size_t>		_request_commands;
+        size_t					_buffer_size = 0;
+        stats					_stats;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+
+// SSE2 is part of x86-64, the kernels using it are built whenever the compiler targets it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NWAASIO_USE_SSE2
+#include <emmintrin.h>
+#endif
+// AVX2 kernels selected at compile time are only built when the compiler targets AVX2
+#if defined(__AVX2__)
+#define NWAASIO_USE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+#define NWAASIO_USE_SSSE3
+#include <tmmintrin.h>
+#endif
+// AVX2 kernels selected at runtime are built even when the compiler does not target AVX2, see cpu_has_avx2
+#if defined(NWAASIO_USE_AVX2)
+#define NWAASIO_BUILD_AVX2
+#define NWAASIO_AVX2_FUNCTION
+#elif defined(NWAASIO_USE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define NWAASIO_BUILD_AVX2
+#define NWAASIO_AVX2_RUNTIME_CHECK
+#define NWAASIO_AVX2_FUNCTION __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define NWAASIO_BUILD_AVX2
+#define NWAASIO_AVX2_RUNTIME_CHECK
+#define NWAASIO_AVX2_FUNCTION
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace nwaasio {
+    /**
+     * @brief The index of the lowest set bit of value, it must not be 0
+     */
+    inline unsigned int count_trailing_zeros(uint32_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    /**
+     * @brief Whether the functions marked NWAASIO_AVX2_FUNCTION can run on this cpu
+     */
+    inline bool cpu_has_avx2()
+    {
+#if !defined(NWAASIO_BUILD_AVX2)
+        return false;
+#elif !defined(NWAASIO_AVX2_RUNTIME_CHECK)
+        return true;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstring>
+#include "nwaasiowatcher.h"
+
+namespace nwaasio {
+
+watcher::watcher(asio::io_service& io_service, client& c)
+	: _client(c), _timer(io_service)
+{
+}
+
+
+watcher::~watcher()
+{
+	// The batch ignores the replies of the poll in progress, they can arrive after the watcher is gone
+	stop();
+	*_alive = false;
+}
+
+
+size_t watcher::add(const std::string& domain, uint32_t address, uint32_t size, change_callback callback)
+{
+	_watches.push_back(_watch{domain, address, size, std::move(callback), true, false, _previous.size(),
+		_min_period, std::chrono::steady_clock::now(), {}, {}, 0, 0});
+	_previous.resize(_previous.size() + size);
+	return _watches.size() - 1;
+}
+
+
+void watcher::remove(size_t id)
+{
+	if (id >= _watches.size() || _watches[id].active == false)
+		return;
+	_watches[id].active = false;
+	_watches[id].callback = nullptr;
+	_removed = true;
+}
+
+
+void watcher::set_adaptive(bool enabled, std::chrono::steady_clock::duration min_period, std::chrono::steady_clock::duration max_period)
+{
+	_adaptive = enabled;
+	_min_period = min_period;
+	_max_period = std::max(min_period, max_period);
+	for (_watch& watch : _watches)
+		watch.period = std::clamp(watch.period, _min_period, _max_period);
+}
+
+
+watcher::watch_stats watcher::watch_statistics(size_t id) const
+{
+	const _watch& watch = _watches.at(id);
+	watch_stats s;
+	s.period = _adaptive ? _effective_period(watch) : _interval;
+	s.polls = watch.polls;
+	s.changes = watch.changes;
+	s.elapsed = watch.last_poll - watch.first_poll;
+	return s;
+}
+
+
+std::chrono::steady_clock::duration watcher::_effective_period(const _watch& watch) const
+{
+	if (_budget_scale == 1.0)
+		return watch.period;
+	auto stretched = std::chrono::duration_cast<std::chrono::steady_clock::duration>(watch.period * _budget_scale);
+	return std::min(stretched, _max_period);
+}
+
+
+void watcher::set_gap_threshold(uint32_t bytes)
+{
+	_batch.set_gap_threshold(bytes);
+}
+
+
+void watcher::start()
+{
+	if (_running)
+		return;
+	_running = true;
+	auto now = std::chrono::steady_clock::now();
+	_poll(now);
+	_timer.expires_at(now + _tick());
+	_schedule();
+}
+
+
+void watcher::stop()
+{
+	if (_running == false)
+		return;
+	_running = false;
+	_timer.cancel();
+	// The replies of the poll in progress are ignored and keep their own buffer, start can poll again right away
+	_batch.cancel();
+}
+
+
+void watcher::_schedule()
+{
+	// A wait that completed before being cancelled still calls the handler without an error
+	_timer.async_wait([this, alive = _alive](const asio::error_code& error) {
+		if (error || *alive == false)
+			return;
+		_handle_timer();
+	});
+}
+
+
+void watcher::_handle_timer()
+{
+	if (_running == false)
+		return;
+	_poll(_timer.expiry());
+	// Keep a fixed rate, unless the polls are late by more than an interval
+	auto now = std::chrono::steady_clock::now();
+	auto next = _timer.expiry() + _tick();
+	_timer.expires_at(next < now ? now + _tick() : next);
+	_schedule();
+}
+
+
+void watcher::_poll(std::chrono::steady_clock::time_point tick_time)
+{
+	if (_batch.busy())
+	{
+		_stats.skipped_polls++;
+		return;
+	}
+	if (_removed)
+		_compact_previous();
+	double demand = 0;
+	_due.clear();
+	for (size_t id = 0; id < _watches.size(); id++)
+	{
+		const _watch& watch = _watches[id];
+		if (watch.active == false)
+			continue;
+		if (_adaptive == false || watch.next_due <= tick_time)
+			_due.push_back(id);
+		demand += watch.size / std::chrono::duration<double>(watch.period).count();
+	}
+	_budget_scale = _adaptive && _byte_budget != 0 && demand > _byte_budget ? demand / _byte_budget : 1.0;
+	if (_due.empty())
+		return;
+	// The same watches are due at each poll in the fixed mode, the batch is built once
+	if (_due != _batch_watches)
+		_rebuild_batch();
+	if (_batch.send(_client) == false)
+		return;
+	_stats.polls++;
+	_stats.bytes_read += _batch.plan_stats().read_bytes;
+	// The next due time follows the ticks, not the time the handler ran, or a late wake up would
+	// push a watch at min_period to the tick after the next one
+	auto now = std::chrono::steady_clock::now();
+	for (size_t id : _due)
+	{
+		_watch& watch = _watches[id];
+		if (watch.polls == 0)
+			watch.first_poll = now;
+		watch.last_poll = now;
+		watch.polls++;
+		watch.next_due = tick_time + _effective_period(watch);
+	}
+}
+
+
+void watcher::_compact_previous()
+{
+	// Removed watches give back their room in _previous
+	std::vector<uint8_t> previous;
+	for (_watch& watch : _watches)
+	{
+		if (watch.active == false)
+			continue;
+		previous.insert(previous.end(), _previous.begin() + watch.previous_offset, _previous.begin() + watch.previous_offset + watch.size);
+		watch.previous_offset = previous.size() - watch.size;
+	}
+	_previous.swap(previous);
+	_removed = false;
+}
+
+
+void watcher::_rebuild_batch()
+{
+	_batch.clear();
+	for (size_t id : _due)
+	{
+		const _watch& watch = _watches[id];
+		_batch.add(watch.domain, watch.address, watch.size, [this, id](const uint8_t* data, size_t size) {
+			_watch_data(id, data, size);
+		});
+	}
+	_batch_watches = _due;
+}
+
+
+void watcher::_watch_data(size_t id, const uint8_t* data, size_t size)
+{
+	_watch& watch = _watches[id];
+	if (watch.active == false)
+		return;
+	uint8_t* previous = _previous.data() + watch.previous_offset;
+	bool changed = watch.has_data == false || memcmp(previous, data, size) != 0;
+	if (_adaptive && watch.has_data)
+	{
+		if (changed)
+			watch.period = std::max(watch.period / 2, _min_period);
+		else
+			watch.period = std::min(watch.period + watch.period / 4, _max_period);
+	}
+	if (changed == false)
+		return;
+	memcpy(previous, data, size);
+	watch.has_data = true;
+	watch.changes++;
+	_stats.changes++;
+	// The callback can remove its own watch, it must not be destroyed while it runs
+	change_callback callback = std::move(watch.callback);
+	if (callback == nullptr)
+		return;
+	callback(data, size);
+	if (watch.active)
+		watch.callback = std::move(callback);
+}
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nwaasioclient.h"
+#include "nwaasiofunction.h"
+#include "nwaasioreadbatch.h"
+#include <asio/steady_timer.hpp>
+
+namespace nwaasio {
+    /**
+     * @brief Polls memory ranges of the emulator and tells when their content changes
+     *
+     * All the watches are read at each poll with a single read_batch, so close ranges are merged
+     * and the whole poll costs a few commands. The data of each watch is compared with the data
+     * of the previous poll and its callback is only called when a byte changed.
+     * In adaptive mode each watch has its own period, see set_adaptive.
+     */
+    class watcher {
+    public:
+        /**
+         * @brief The function called with the new data of a watch, the data is valid during the call
+         */
+        using change_callback = unique_function<void(const uint8_t* data, size_t size)>;
+        struct stats {
+            uint64_t	polls = 0;
+            // The polls not sent because the previous one had no reply yet
+            uint64_t	skipped_polls = 0;
+            uint64_t	changes = 0;
+            uint64_t	bytes_read = 0;
+        };
+        struct watch_stats {
+            // The time between two reads of the watch, with the byte budget applied
+            std::chrono::steady_clock::duration	period{};
+            uint64_t	polls = 0;
+            uint64_t	changes = 0;
+            // The time from the first read of the watch to the last one
+            std::chrono::steady_clock::duration	elapsed{};
+            /**
+             * @brief The reads per second the period asks for
+             */
+            double		rate() const { return period.count() == 0 ? 0.0 : 1.0 / std::chrono::duration<double>(period).count(); }
+            /**
+             * @brief The reads per second measured from the first read to the last one, it is lower
+             * than rate() when polls are skipped because the previous one had no reply yet
+             */
+            double		measured_rate() const { return polls < 2 || elapsed.count() == 0 ? 0.0 : (polls - 1) / std::chrono::duration<double>(elapsed).count(); }
+        };
+
+        /**
+         * @brief Create a watcher, it does not poll until start is called
+         * @param io_service The asio io service context of the client
+         * @param c The client used to read the memory, it must outlive the watcher
+         */
+        watcher(asio::io_service& io_service, client& c);
+        ~watcher();
+        watcher(const watcher&) = delete;
+        watcher& operator=(const watcher&) = delete;
+
+        /**
+         * @brief Watch a memory range
+         * @param domain The memory domain, like WRAM
+         * @param address The address of the data in the domain
+         * @param size The size of the data
+         * @param callback Called with the data on the first poll, then each time it changes
+         * @return an identifier to remove the watch
+         */
+        size_t	add(const std::string& domain, uint32_t address, uint32_t size, change_callback callback);
+        /**
+         * @brief Stop watching a memory range, it can be called from the callback of the watch
+         * @param id The identifier returned by add
+         */
+        void	remove(size_t id);
+        /**
+         * @brief Set the time between two polls, the default is 16ms
+         */
+        void	set_interval(std::chrono::steady_clock::duration interval) { _interval = interval; }
+        /**
+         * @brief Give each watch its own period adapted to how often its data changes
+         * A watch whose data changed is read twice as often, a watch whose data did not change is read
+         * a quarter less often, within min_period and max_period. The timer ticks every min_period and
+         * the watches due at a tick are read with a single batch. When disabled, the default, all the
+         * watches are read every interval.
+         * @param enabled true to enable the adaptive mode
+         * @param min_period The shortest period, new watches start with it
+         * @param max_period The longest period
+         */
+        void	set_adaptive(bool enabled, std::chrono::steady_clock::duration min_period = std::chrono::milliseconds(16),
+                    std::chrono::steady_clock::duration max_period = std::chrono::seconds(1));
+        /**
+         * @brief Limit the bytes read per second in adaptive mode, the periods are stretched to fit but
+         * never above max_period. 0, the default, is no limit.
+         */
+        void	set_byte_budget(uint64_t bytes_per_second) { _byte_budget = bytes_per_second; }
+        /**
+         * @brief Set the largest gap between two watches that are read as a single range, see read_planner
+         */
+        void	set_gap_threshold(uint32_t bytes);
+        /**
+         * @brief Start polling, the first poll is sent right away
+         */
+        void	start();
+        /**
+         * @brief Stop polling, the poll in progress is dropped and its replies are ignored
+         * Stop the watcher when the client lost the connection and start it again after
+         */
+        void	stop();
+        bool	running() const { return _running; }
+        const stats&	statistics() const { return _stats; }
+        /**
+         * @brief The period and the counters of a watch
+         * @param id The identifier returned by add
+         */
+        watch_stats		watch_statistics(size_t id) const;
+
+    private:
+        struct _watch {
+            std::string		domain;
+            uint32_t		address;
+            uint32_t		size;
+            change_callback	callback;
+            bool			active;
+            bool			has_data;
+            // Where the data of the previous poll is in _previous
+            size_t			previous_offset;
+            std::chrono::steady_clock::duration		period;
+            std::chrono::steady_clock::time_point	next_due;
+            std::chrono::steady_clock::time_point	first_poll;
+            std::chrono::steady_clock::time_point	last_poll;
+            uint64_t		polls;
+            uint64_t		changes;
+        };
+        client&						_client;
+        asio::steady_timer			_timer;
+        std::chrono::steady_clock::duration	_interval = std::chrono::milliseconds(16);
+        bool						_adaptive = false;
+        std::chrono::steady_clock::duration	_min_period = std::chrono::milliseconds(16);
+        std::chrono::steady_clock::duration	_max_period = std::chrono::seconds(1);
+        uint64_t					_byte_budget = 0;
+        // How much the periods are stretched to fit in the byte budget
+        double						_budget_scale = 1.0;
+        bool						_running = false;
+        // A callback can add a watch, a deque keeps the watch being called in place
+        std::deque<_watch>			_watches;
+        std::vector<uint8_t>		_previous;
+        read_batch					_batch;
+        // The watches read by the batch, and the ones due at this poll
+        std::vector<size_t>			_batch_watches;
+        std::vector<size_t>			_due;
+        bool						_removed = false;
+        stats						_stats;
+        // Set to false by the destructor, a timer completion already queued can still run after it
+        std::shared_ptr<bool>		_alive = std::make_shared<bool>(true);
+
+        std::chrono::steady_clock::duration	_tick() const { return _adaptive ? _min_period : _interval; }
+        std::chrono::steady_clock::duration	_effective_period(const _watch& watch) const;
+        void	_schedule();
+        void	_handle_timer();
+        void	_poll(std::chrono::steady_clock::time_point tick_time);
+        void	_compact_previous();
+        void	_rebuild_batch();
+        void	_watch_data(size_t id, const uint8_t* data, size_t size);
+    };
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cstring>
+#include "nwaasiowritebuffer.h"
+
+namespace nwaasio {
+
+struct write_buffer::_flush_state {
+	size_t			pending_commands = 0;
+	bool			success = true;
+	done_callback	done;
+};
+
+
+write_buffer::write_buffer(asio::io_service& io_service, client& c)
+	: _client(c), _timer(io_service)
+{
+}
+
+
+write_buffer::~write_buffer()
+{
+	// The commands of a flush do not use the write buffer, the pending writes can still be sent
+	flush();
+	*_alive = false;
+}
+
+
+void write_buffer::set_command_limits(size_t max_ranges, size_t max_bytes)
+{
+	_max_ranges = std::max(max_ranges, (size_t) 1);
+	_max_bytes = std::max(max_bytes, (size_t) 1);
+}
+
+
+void write_buffer::write(const std::string& domain, uint32_t address, const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return;
+	_stats.writes++;
+	_ranges& ranges = _domains[domain];
+	uint64_t end = (uint64_t) address + size;
+
+	// The ranges that overlap or touch the write are merged with it
+	auto first = ranges.upper_bound(address);
+	if (first != ranges.begin())
+	{
+		auto previous = std::prev(first);
+		if (previous->first + previous->second.size() >= address)
+			first = previous;
+	}
+	auto last = first;
+	while (last != ranges.end() && last->first <= end)
+		last++;
+
+	if (first != last && std::next(first) == last && first->first <= address && first->first + first->second.size() >= end)
+	{
+		// The write is inside a pending range
+		memcpy(first->second.data() + (address - first->first), data, size);
+		_stats.overwritten_bytes += size;
+	}
+	else {
+		uint32_t merged_begin = address;
+		uint64_t merged_end = end;
+		if (first != last)
+		{
+			merged_begin = std::min(address, first->first);
+			auto back = std::prev(last);
+			merged_end = std::max(end, back->first + (uint64_t) back->second.size());
+		}
+		std::vector<uint8_t> merged(merged_end - merged_begin);
+		for (auto it = first; it != last; it++)
+		{
+			memcpy(merged.data() + (it->first - merged_begin), it->second.data(), it->second.size());
+			uint64_t overlap_begin = std::max((uint64_t) it->first, (uint64_t) address);
+			uint64_t overlap_end = std::min(it->first + (uint64_t) it->second.size(), end);
+			if (overlap_end > overlap_begin)
+				_stats.overwritten_bytes += overlap_end - overlap_begin;
+			_pending_bytes -= it->second.size();
+		}
+		memcpy(merged.data() + (address - merged_begin), data, size);
+		_pending_bytes += merged.size();
+		ranges.erase(first, last);
+		ranges.emplace(merged_begin, std::move(merged));
+	}
+
+	if (_pending_bytes >= _flush_threshold)
+	{
+		flush();
+	}
+	else if (_flush_delay.count() != 0 && _timer_armed == false)
+	{
+		_timer_armed = true;
+		_timer.expires_after(_flush_delay);
+		// Cancelling a wait that already completed does not stop its handler, flush or the destructor may have run
+		_timer.async_wait([this, alive = _alive](const asio::error_code& error) {
+			if (error || *alive == false || _timer_armed == false)
+				return;
+			_timer_armed = false;
+			flush();
+		});
+	}
+}
+
+
+bool write_buffer::overlay(const std::string& domain, uint32_t address, uint8_t* data, size_t size) const
+{
+	auto d = _domains.find(domain);
+	if (d == _domains.end())
+		return false;
+	const _ranges& ranges = d->second;
+	uint64_t end = (uint64_t) address + size;
+	auto it = ranges.upper_bound(address);
+	if (it != ranges.begin())
+		it--;
+	bool found = false;
+	for (; it != ranges.end() && it->first < end; it++)
+	{
+		uint64_t begin = std::max((uint64_t) it->first, (uint64_t) address);
+		uint64_t range_end = std::min(it->first + (uint64_t) it->second.size(), end);
+		if (range_end <= begin)
+			continue;
+		memcpy(data + (begin - address), it->second.data() + (begin - it->first), range_end - begin);
+		found = true;
+	}
+	return found;
+}
+
+
+void write_buffer::flush(done_callback done)
+{
+	if (_timer_armed)
+	{
+		_timer_armed = false;
+		_timer.cancel();
+	}
+	auto state = std::make_shared<_flush_state>();
+	state->done = std::move(done);
+	// Count every command before sending any so done is not called early
+	state->pending_commands = 1;
+	if (_domains.empty() == false)
+		_stats.flushes++;
+	for (auto& d : _domains)
+		_flush_domain(d.first, d.second, state);
+	_domains.clear();
+	_pending_bytes = 0;
+	if (--state->pending_commands == 0 && state->done != nullptr)
+		state->done(state->success);
+}
+
+
+void write_buffer::_flush_domain(const std::string& domain, _ranges& ranges, const std::shared_ptr<_flush_state>& state)
+{
+	auto it = ranges.begin();
+	while (it != ranges.end())
+	{
+		// Gather the ranges of a command then copy their data one after the other
+		auto command_end = it;
+		size_t count = 0;
+		size_t size = 0;
+		while (command_end != ranges.end() && count < _max_ranges && (count == 0 || size + command_end->second.size() <= _max_bytes))
+		{
+			size += command_end->second.size();
+			count++;
+			command_end++;
+		}
+		std::string args = domain;
+		payload data = _pool.allocate(size);
+		size_t offset = 0;
+		for (; it != command_end; it++)
+		{
+			args.push_back(';');
+			append_hex_argument(args, it->first);
+			args.push_back(';');
+			append_hex_argument(args, it->second.size());
+			memcpy(data.data() + offset, it->second.data(), it->second.size());
+			offset += it->second.size();
+		}
+		_stats.commands++;
+		_stats.bytes_sent += size;
+		state->pending_commands++;
+		asio::const_buffer buffer(data.data(), size);
+		_client.binary_command("bCORE_WRITE", args, buffer, [state, data = std::move(data)](const reply& r) {
+			if (r.is_error() || r.is_valid() == false)
+				state->success = false;
+			if (--state->pending_commands == 0 && state->done != nullptr)
+				state->done(state->success);
+		});
+	}
+}
+
+
+void write_buffer::read(const std::string& domain, const std::string& args, reply_callback callback)
+{
+	auto d = _domains.find(domain);
+	if (d != _domains.end())
+	{
+		auto state = std::make_shared<_flush_state>();
+		_flush_domain(d->first, d->second, state);
+		for (const auto& range : d->second)
+			_pending_bytes -= range.second.size();
+		_domains.erase(d);
+	}
+	_client.command("CORE_READ", domain + ";" + args, std::move(callback));
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nwaasiobuffer.h"
+#include "nwaasioclient.h"
+#include "nwaasiofunction.h"
+#include <asio/steady_timer.hpp>
+
+namespace nwaasio {
+    /**
+     * @brief Collects memory writes and sends them as a few bCORE_WRITE commands
+     *
+     * The writes of a domain are merged in ranges, a byte written twice keeps its last value and
+     * adjacent writes become a single range. The ranges are sent on flush, when the pending bytes
+     * reach a threshold or after a delay, each command carries several offset;size pairs.
+     * The commands are sent in order on the connection, so a read sent after a flush sees its
+     * writes, read() flushes the domain before reading to keep this true for pending writes.
+     */
+    class write_buffer {
+    public:
+        using done_callback = unique_function<void(bool success)>;
+        struct stats {
+            uint64_t	writes = 0;
+            // The bytes written more than once before being sent
+            uint64_t	overwritten_bytes = 0;
+            uint64_t	flushes = 0;
+            uint64_t	commands = 0;
+            uint64_t	bytes_sent = 0;
+        };
+
+        /**
+         * @brief Create a write buffer
+         * @param io_service The asio io service context of the client
+         * @param c The client used to send the writes, it must outlive the write buffer
+         */
+        write_buffer(asio::io_service& io_service, client& c);
+        ~write_buffer();
+        write_buffer(const write_buffer&) = delete;
+        write_buffer& operator=(const write_buffer&) = delete;
+
+        /**
+         * @brief Add a write, the data is copied
+         * @param domain The memory domain, like WRAM
+         * @param address The address of the data in the domain
+         * @param data The data to write
+         * @param size The size of the data
+         */
+        void	write(const std::string& domain, uint32_t address, const uint8_t* data, size_t size);
+        /**
+         * @brief Send all the pending writes
+         * @param done An optionnal callback called once the emulator replied to all the commands
+         */
+        void	flush(done_callback done = nullptr);
+        /**
+         * @brief Read memory with CORE_READ, the pending writes of the domain are sent before
+         * @param domain The memory domain, like WRAM
+         * @param args The CORE_READ arguments after the domain, like $10;$20
+         * @param callback Called with the reply of CORE_READ
+         */
+        void	read(const std::string& domain, const std::string& args, reply_callback callback);
+        /**
+         * @brief Write the pending bytes of a range over data, for data read from somewhere else, like a memory_mirror
+         * @return true if there was pending bytes in the range
+         */
+        bool	overlay(const std::string& domain, uint32_t address, uint8_t* data, size_t size) const;
+        /**
+         * @brief The number of bytes waiting to be sent
+         */
+        size_t	pending_bytes() const { return _pending_bytes; }
+        /**
+         * @brief Flush when the pending bytes reach threshold, the default is 16 KiB
+         */
+        void	set_flush_threshold(size_t threshold) { _flush_threshold = threshold; }
+        /**
+         * @brief Flush this long after the first pending write, 0 to only flush explicitly or on the threshold, the default
+         */
+        void	set_flush_delay(std::chrono::steady_clock::duration delay) { _flush_delay = delay; }
+        /**
+         * @brief Set the limits of a single command, a range bigger than max_bytes gets its own command
+         * @param max_ranges The maximum number of offset;size pairs in a command, the default is 64
+         * @param max_bytes The maximum size of the data of a command, the default is 64 KiB
+         */
+        void	set_command_limits(size_t max_ranges, size_t max_bytes);
+        const stats&	statistics() const { return _stats; }
+
+    private:
+        // The pending ranges of a domain by address, they never overlap nor touch
+        using _ranges = std::map<uint32_t, std::vector<uint8_t> >;
+        // What the callbacks of the commands of a flush share, it does not point to the write buffer
+        struct _flush_state;
+        client&				_client;
+        asio::steady_timer	_timer;
+        bool				_timer_armed = false;
+        std::map<std::string, _ranges>	_domains;
+        size_t				_pending_bytes = 0;
+        size_t				_flush_threshold = 16 * 1024;
+        std::chrono::steady_clock::duration	_flush_delay{};
+        size_t				_max_ranges = 64;
+        size_t				_max_bytes = 64 * 1024;
+        buffer_pool			_pool;
+        stats				_stats;
+        // Cleared by the destructor, the timer handler checks it before touching the write buffer
+        std::shared_ptr<bool>	_alive = std::make_shared<bool>(true);
+
+        void	_flush_domain(const std::string& domain, _ranges& ranges, const std::shared_ptr<_flush_state>& state);
+    };
+}